@@ -1,21 +1,636 @@
 #include "interoperability/macro.hpp"
 
 #include <iostream>
+#include <fstream>
 #include <chrono>
+#include <cstdio>
 #include <string>
 
 #include "util/memory.hpp"
 #include "util/ansi_text.hpp"
+#include "util/gaps.hpp"
+#include "util/async_writer.hpp"
 #include "sieving_strategies.hpp"
+#include "listing.hpp"
+#include "tuning.hpp"
+#include "cluster.hpp"
+#include "server.hpp"
+#include "poly.hpp"
 #include "ulam.hpp"
 
+#include "interoperability/mutex.hpp"
+#include "interoperability/semaphore.hpp"
+#include "interoperability/mapped_file.hpp"
+
+#define serve_mux_name "__mux__L3__serve__"
+#define serve_sem_name "__sem__L3__serve__"
+
 using namespace std::string_literals;
 
 enum struct output
 {
-    None, Text, Image
+    None, Text, Image, Gaps, List, Tiles, Heatmap, Tiff
+};
+
+/// @brief Count of numbers sieved at once when exporting prime list (bit storage - 16 MiB of memory)
+constexpr long long Export_Segment = 1LL << 27;
+/// @brief Largest range, for which Ulam Spiral is rendered from sieve held in memory
+constexpr long long Spiral_In_Core_Limit = (long long)2e8;
+/// @brief Bit sieve file used to render larger spirals
+constexpr char const* Spiral_Cache = "spiral.cache";
+/// @brief Default max side of heatmap in pixels
+constexpr long long Heat_Side = 2048;
+/// @brief Default max pixels of Ulam Spiral image - larger spirals are shown as heatmap instead (1 GiB of 8 bit bmp)
+constexpr long long Pixel_Budget = 1LL << 30;
+
+
+/* ===================================================================================================== */
+/* Coordinator of cluster mode - distributes range between worker processes, that connect to its socket. */
+/* Prints count of primes found, and optionally saves bit sieve of whole range                           */
+/* ===================================================================================================== */
+int coordinator_main(int argc, char const* argv[])
+{
+    if (argc < 4)
+    {
+        std::cerr
+            << ANSI::b_red << "Two few args."
+            << ANSI::b_yellow << " Usage: " << argv[0] << " coordinator [socket] [n] <low = 0> <chunk = 1e8> <result = count>"
+            << ANSI::reset << "\nWhere: \n"
+            << ANSI::b_green << "          socket "
+            << ANSI::reset << "- path of local socket that workers connect to\n"
+            << ANSI::b_green << "        n / low "
+            << ANSI::reset << "- bounds (inclusive) of searched range\n"
+            << ANSI::b_green << "           chunk "
+            << ANSI::reset << "- count of numbers handed to worker at once\n"
+            << ANSI::b_green << "          result "
+            << ANSI::reset << "- `count' for prime count only, `bits' to also save bit sieve of range to primes.bits"
+            << " (64-bit little-endian words, bit set for composite, first bit is <low> rounded down to multiple of 64)\n";
+        return 1;
+    }
+
+    long long n = std::atoll(argv[3]);
+    long long low = argc >= 5 ? std::atoll(argv[4]) : 0;
+    long long chunk = argc >= 6 ? std::atoll(argv[5]) : (long long)1e8;
+    bool bits = argc >= 7 && "bits"s == argv[6];
+    if (n <= 0 || low < 0 || low > n || chunk <= 0)
+    {
+        std::cerr
+            << ANSI::b_red << "Required: 0 <= <low> <= [n], <chunk> > 0"
+            << ANSI::reset << "\n";
+        return 2;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    try
+    {
+        auto res = cluster::coordinator(argv[2], low, n, chunk, bits, std::cerr);
+        auto end = std::chrono::high_resolution_clock::now();
+        auto ns = (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+        std::cout << "Primes in range:  " << res.count << "\n";
+        std::cout << "Calculation time: " << ns / 1'000'000 << "ms " << ns % 1'000'000 << "ns\n";
+
+        if (bits)
+        {
+            std::ofstream out("primes.bits", out.binary | out.trunc);
+            out.write((char const*)res.bits.ptr(), res.bits.len() * sizeof(uint64_t));
+            out.close();
+            res.bits.free();
+            if (!out)
+            {
+                std::cerr
+                    << ANSI::b_red << "Cannot write primes.bits"
+                    << ANSI::reset << "\n";
+                return 5;
+            }
+        }
+    }
+    catch (i_op::error_msg const& e)
+    {
+        std::cerr << e << "\n";
+        return 3;
+    }
+    catch (std::bad_alloc const&)
+    {
+        std::cerr
+            << ANSI::b_red << "Cannot allocate memory for sieve of range"
+            << ANSI::reset << "\n";
+        return 4;
+    }
+
+    return 0;
+}
+
+/* ============================================================================================= */
+/* Worker of cluster mode - sieves ranges received from coordinator, until it tells to shut down */
+/* ============================================================================================= */
+int worker_main(int argc, char const* argv[])
+{
+    if (argc < 3)
+    {
+        std::cerr
+            << ANSI::b_red << "Two few args."
+            << ANSI::b_yellow << " Usage: " << argv[0] << " worker [socket] <max threads = -1>"
+            << ANSI::reset << "\n";
+        return 1;
+    }
+
+    int th = argc >= 4 ? std::atoi(argv[3]) : -1;
+    if (th < 1 && th != -1)
+    {
+        std::cerr
+            << ANSI::b_red << "<max threads> must be positive or `-1' for limited by hardware"
+            << ANSI::reset << "\n";
+        return 5;
+    }
+
+    return cluster::worker(argv[2], th, std::cerr);
+}
+
+
+/* ========================================================================================================= */
+/* Query daemon - sieves range once, and answers requests of clients connected to its socket until shutdown. */
+/* Only one daemon may run at the time - detected the same way as in L1_B, with robust mutex recovering      */
+/* after instance that was aborted                                                                           */
+/* ========================================================================================================= */
+int serve_main(int argc, char const* argv[])
+{
+    if (argc < 4)
+    {
+        std::cerr
+            << ANSI::b_red << "Two few args."
+            << ANSI::b_yellow << " Usage: " << argv[0] << " serve [socket] [n] <max threads = -1>"
+            << ANSI::reset << "\nWhere: \n"
+            << ANSI::b_green << "          socket "
+            << ANSI::reset << "- path of local socket that clients connect to\n"
+            << ANSI::b_green << "               n "
+            << ANSI::reset << "- upper bound of range kept in memory\n"
+            << "Requests (one per line): is_prime [x], pi [x], nth_prime [k], primes_in [a] [b], shutdown\n";
+        return 1;
+    }
+
+    long long n = std::atoll(argv[3]);
+    if (n <= 0)
+    {
+        std::cerr
+            << ANSI::b_red << "Negative [n] not allowed"
+            << ANSI::reset << "\n";
+        return 2;
+    }
+    int th = argc >= 5 ? std::atoi(argv[4]) : -1;
+    if (th < 1 && th != -1)
+    {
+        std::cerr
+            << ANSI::b_red << "<max threads> must be positive or `-1' for limited by hardware"
+            << ANSI::reset << "\n";
+        return 5;
+    }
+
+    /* ================================================================================== */
+    /* Semaphore is taken while daemon runs, mutex detects if previous one was terminated */
+    /* ================================================================================== */
+    i_op::named_mutex abort_detect(serve_mux_name);
+    i_op::named_semaphore abort_signal(serve_sem_name, 1);
+    if (abort_signal.try_acquire())
+    {
+        abort_detect.lock();
+    }
+    else if (abort_detect.try_lock() == i_op::mux_result::Recovered)
+    {
+        std::cerr
+            << ANSI::b_blue << "Previous instance terminated abnormally."
+            << ANSI::reset << "\nRecovered resources.\n";
+        abort_signal.release();
+        abort_signal.acquire();
+    }
+    else
+    {
+        std::cerr
+            << ANSI::b_red << "Another query daemon is already running!"
+            << ANSI::reset << "\nSend it `shutdown' request first\n";
+#ifdef OS_WIN32
+        return ERROR_ALREADY_EXISTS;
+#endif
+#ifdef OS_LINUX
+        return EALREADY;
+#endif
+    }
+
+    int ret = 0;
+    try
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        query::table table(n, th);
+        auto end = std::chrono::high_resolution_clock::now();
+        auto ns = (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        std::cerr << "Sieving time: " << ns / 1'000'000 << "ms " << ns % 1'000'000 << "ns\n";
+
+        server::serve(argv[2], table, std::cerr);
+    }
+    catch (std::bad_alloc const&)
+    {
+        std::cerr
+            << ANSI::b_red << "[n] value too big - cannot allocate memory for sieve"
+            << ANSI::reset << "\n";
+        ret = 5;
+    }
+    catch (i_op::error_msg const& e)
+    {
+        std::cerr << e << "\n";
+        ret = 3;
+    }
+
+    abort_detect.release();
+    abort_signal.release();
+    return ret;
+}
+
+/* =================================================================== */
+/* Query client - sends single request to daemon, and prints its reply */
+/* =================================================================== */
+int query_main(int argc, char const* argv[])
+{
+    if (argc < 4)
+    {
+        std::cerr
+            << ANSI::b_red << "Two few args."
+            << ANSI::b_yellow << " Usage: " << argv[0] << " query [socket] [request...]"
+            << ANSI::reset << " - for example `" << argv[0] << " query /tmp/primes.sock pi 1000'\n";
+        return 1;
+    }
+
+    std::string line = argv[3];
+    for (int i = 4; i < argc; i++) { line += " "s + argv[i]; }
+
+    try
+    {
+        auto reply = server::request(argv[2], line);
+        std::cout << reply << "\n";
+        return reply.rfind("error:", 0) == 0 ? 2 : 0;
+    }
+    catch (i_op::error_msg const& e)
+    {
+        std::cerr << e << "\n";
+        return 3;
+    }
+}
+
+/* ================================================================================================== */
+/* Prime density of Ulam Spiral diagonals - values of 4k^2 + bk + c for k = 0..K are sieved directly, */
+/* without sieving every number up to them. Without polynomials given, three diagonals that meet in   */
+/* corners of rings are used (fourth one holds only odd squares)                                      */
+/* ================================================================================================== */
+int diagonals_main(int argc, char const* argv[])
+{
+    if (argc < 3)
+    {
+        std::cerr
+            << ANSI::b_red << "Two few args."
+            << ANSI::b_yellow << " Usage: " << argv[0] << " diagonals [K] <max threads = -1> <b c>..."
+            << ANSI::reset << "\nWhere: \n"
+            << ANSI::b_green << "               K "
+            << ANSI::reset << "- last k, for which values are sieved\n"
+            << ANSI::b_green << "             b c "
+            << ANSI::reset << "- coefficients of polynomials 4k^2 + bk + c (default: -2 1, 0 1, 2 1)\n";
+        return 1;
+    }
+
+    long long k = std::atoll(argv[2]);
+    if (k < 0)
+    {
+        std::cerr
+            << ANSI::b_red << "Negative [K] not allowed"
+            << ANSI::reset << "\n";
+        return 2;
+    }
+    int th = argc >= 4 ? std::atoi(argv[3]) : -1;
+    if (th < 1 && th != -1)
+    {
+        std::cerr
+            << ANSI::b_red << "<max threads> must be positive or `-1' for limited by hardware"
+            << ANSI::reset << "\n";
+        return 5;
+    }
+
+    std::vector<poly::quadratic> polys;
+    for (int i = 4; i + 1 < argc; i += 2)
+    {
+        polys.push_back(poly::quadratic{ 4, std::atoll(argv[i]), std::atoll(argv[i + 1]) });
+    }
+    if (polys.empty())
+    {
+        polys = { { 4, -2, 1 }, { 4, 0, 1 }, { 4, 2, 1 } };
+    }
+    auto name = [](poly::quadratic const& _f)
+    {
+        return "4k^2 "s + (_f.b < 0 ? "- " : "+ ") + std::to_string(std::abs(_f.b)) + "k "
+            + (_f.c < 0 ? "- " : "+ ") + std::to_string(std::abs(_f.c));
+    };
+    for (auto const& f : polys)
+    {
+        if (!poly::fits(f, k))
+        {
+            std::cerr
+                << ANSI::b_red << "Values of " << name(f) << " exceed " << poly::Value_Limit
+                << ANSI::reset << "\n";
+            return 3;
+        }
+    }
+
+    try
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        auto result = poly::diagonals(polys, k, th);
+        auto end = std::chrono::high_resolution_clock::now();
+        auto ns = (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+        for (auto const& d : result)
+        {
+            std::cout
+                << name(d.f) << ": "
+                << d.primes << " primes of " << d.values << " values, density " << (double)d.primes / d.values
+                << ", " << (d.expected > 0 ? d.primes / d.expected : 0) << " of expected\n";
+        }
+        std::cout << "Calculation time: " << ns / 1'000'000 << "ms " << ns % 1'000'000 << "ns\n";
+    }
+    catch (std::bad_alloc const&)
+    {
+        std::cerr
+            << ANSI::b_red << "[K] value too big - cannot allocate memory for sieve"
+            << ANSI::reset << "\n";
+        return 5;
+    }
+
+    return 0;
+}
+
+/* ============================================================================ */
+/* Bits per pixel of image output - selected by `PRIME_BMP_DEPTH`, 8 if not set */
+/* ============================================================================ */
+uint16_t bmp_depth()
+{
+    if (getenv("PRIME_BMP_DEPTH") != nullptr)
+    {
+        if ("1"s == getenv("PRIME_BMP_DEPTH")) { return 1; }
+        if ("24"s == getenv("PRIME_BMP_DEPTH")) { return 24; }
+    }
+    return 8;
+}
+
+/* ===================================================================================== */
+/* Max side of heatmap in pixels - selected by `PRIME_HEAT_SIDE`, `Heat_Side` if not set */
+/* ===================================================================================== */
+long long heat_side()
+{
+    if (getenv("PRIME_HEAT_SIDE") != nullptr && std::atoll(getenv("PRIME_HEAT_SIDE")) > 0)
+    {
+        return std::atoll(getenv("PRIME_HEAT_SIDE"));
+    }
+    return Heat_Side;
+}
+
+/* ============================================================================================= */
+/* Max pixels of Ulam Spiral image - selected by `PRIME_PIXEL_BUDGET`, `Pixel_Budget` if not set */
+/* ============================================================================================= */
+long long pixel_budget()
+{
+    if (getenv("PRIME_PIXEL_BUDGET") != nullptr && std::atoll(getenv("PRIME_PIXEL_BUDGET")) > 0)
+    {
+        return std::atoll(getenv("PRIME_PIXEL_BUDGET"));
+    }
+    return Pixel_Budget;
+}
+
+enum struct layout
+{
+    Ulam, Sacks, Klauber
 };
 
+/* ============================================================================= */
+/* Layout of text and image output - selected by `PRIME_LAYOUT`, Ulam if not set */
+/* ============================================================================= */
+layout spiral_layout()
+{
+    if (getenv("PRIME_LAYOUT") != nullptr)
+    {
+        if ("sacks"s == getenv("PRIME_LAYOUT")) { return layout::Sacks; }
+        if ("klauber"s == getenv("PRIME_LAYOUT")) { return layout::Klauber; }
+    }
+    return layout::Ulam;
+}
+
+/* =================================================================================================== */
+/* Writes text, image or tiled image output of numbers 1..n in selected layout, with levels given by   */
+/* `_levels`. Returns `false` if streamed image was not written whole (text and 8 bit bmp output throw */
+/* `i_op::error_msg` instead)                                                                          */
+/* =================================================================================================== */
+template<typename F>
+bool spiral_output(int mode, long long n, F const& _levels, int th)
+{
+    switch (spiral_layout())
+    {
+    case layout::Sacks:
+        return ulam::sacks_of("sacks.bmp", n, _levels, th, bmp_depth());
+    case layout::Klauber:
+        if (mode == (int)output::Text) { ulam::print_of("klauber.txt", ulam::triangle(n), _levels, th); }
+        else if (mode == (int)output::Tiff) { return ulam::tiff_of("klauber.tif", ulam::triangle(n), _levels, th, bmp_depth()); }
+        else { return ulam::picture_of("klauber.bmp", ulam::triangle(n), _levels, th, bmp_depth()); }
+        break;
+    default:
+        if (mode == (int)output::Text) { ulam::print_of("spiral.txt", ulam::spiral(n), _levels, th); }
+        else if (mode == (int)output::Tiff) { return ulam::tiff_of("spiral.tif", ulam::spiral(n), _levels, th, bmp_depth()); }
+        else { return ulam::picture_of("spiral.bmp", ulam::spiral(n), _levels, th, bmp_depth()); }
+        break;
+    }
+    return true;
+}
+
+/* ================================================================================ */
+/* Sieves numbers `lo`..`hi` into bit sieve `part`, with narrow indices if possible */
+/* ================================================================================ */
+void sieve_window(long long lo, long long hi, util::mem<uint64_t>& part, int th, long long seg)
+{
+    if (hi < sieving_strategy::Narrow_Limit)
+    {
+        sieving_strategy::window<uint32_t, sieving_strategy::storage::bit>(lo, hi, part, th, seg);
+    }
+    else
+    {
+        sieving_strategy::window<long long, sieving_strategy::storage::bit>(lo, hi, part, th, seg);
+    }
+}
+
+/* ======================================================================================================= */
+/* Sieves range 0..n in windows of `Export_Segment` numbers, and passes each one to `_feed` right after it */
+/* is sieved - so memory use of exports does not depend on [n]. Stops early if `_feed` returns `false`     */
+/*                                                                                                         */
+/* Returns `false` if memory for window cannot be allocated                                                */
+/* ======================================================================================================= */
+template<typename F>
+bool stream_windows(long long n, int th, long long seg, F _feed)
+{
+    auto window = util::mem<uint64_t>::calloc(Export_Segment / 64);
+    if (window.ptr() == nullptr)
+    {
+        std::cerr
+            << ANSI::b_red << "Cannot allocate memory for sieve window"
+            << ANSI::reset << "\n";
+        return false;
+    }
+
+    for (long long lo = 0; lo <= n; lo += Export_Segment)
+    {
+        long long hi = std::min(n, lo + Export_Segment - 1);
+        auto part = util::mem<uint64_t>::wrap(window.ptr(), (hi - lo) / 64 + 1);
+        sieve_window(lo, hi, part, th, seg);
+        if (!_feed(part.ptr(), lo, hi - lo + 1)) { break; }
+    }
+
+    window.free();
+    return true;
+}
+
+/* ===================================================================== */
+/* Export of prime list to primes.gaps, as varint-encoded gaps in chunks */
+/* ===================================================================== */
+int export_gaps(long long n, int th, long long seg)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    gaps::writer out("primes.gaps");
+    bool fed = stream_windows(n, th, seg, [&](uint64_t const* _words, long long _base, long long _len)
+    {
+        out.feed(_words, _base, _len);
+        return out.good();
+    });
+    if (!fed) { return 5; }
+    bool ok = out.finish(n);
+
+    auto end = std::chrono::high_resolution_clock::now();
+    auto ns = (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    if (!ok)
+    {
+        std::cerr
+            << ANSI::b_red << "Cannot write primes.gaps"
+            << ANSI::reset << "\n";
+        return 6;
+    }
+
+    std::cout << "Primes written:   " << out.count() << "\n";
+    std::cout << "Calculation time: " << ns / 1'000'000 << "ms " << ns % 1'000'000 << "ns\n";
+    return 0;
+}
+
+/* =============================================================================================== */
+/* Export of prime list to stdout, one decimal number per line - so it can be piped to other tools */
+/* (time measures go to stderr then). Windows are formatted concurrently by `listing::writer`      */
+/* =============================================================================================== */
+int export_list(long long n, int th, long long seg)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::ios::sync_with_stdio(false);
+    listing::writer out(std::cout, th);
+    try
+    {
+        bool fed = stream_windows(n, th, seg, [&](uint64_t const* _words, long long _base, long long _len)
+        {
+            out.feed(_words, _base, _len);
+            return out.good();
+        });
+        if (!fed) { return 5; }
+    }
+    catch (std::bad_alloc const&)
+    {
+        std::cerr
+            << ANSI::b_red << "Cannot allocate memory for text buffers"
+            << ANSI::reset << "\n";
+        return 5;
+    }
+    std::cout.flush();
+
+    auto end = std::chrono::high_resolution_clock::now();
+    auto ns = (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    if (!out.good())
+    {
+        std::cerr
+            << ANSI::b_red << "Cannot write prime list"
+            << ANSI::reset << "\n";
+        return 6;
+    }
+
+    std::cerr << "Primes written:   " << out.count() << "\n";
+    std::cerr << "Calculation time: " << ns / 1'000'000 << "ms " << ns % 1'000'000 << "ns\n";
+    return 0;
+}
+
+
+/* ========================================================================================================= */
+/* Ulam Spiral of ranges too large to be held in memory - range is sieved in windows straight into bit sieve */
+/* mapped from spiral.cache file, and spiral is rendered from it band by band. Memory use does not depend on */
+/* [n] - OS pages parts of cache in and out as they are needed                                               */
+/*                                                                                                           */
+/* Heatmaps are always rendered this way, as they count primes by popcount of bit sieve                      */
+/* ========================================================================================================= */
+int spiral_out_of_core(long long n, int mode, int th, long long seg)
+{
+    try
+    {
+        i_op::mapped_file<uint64_t> cache(Spiral_Cache, n / 64 + 1);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (long long lo = 0; lo <= n; lo += Export_Segment)
+        {
+            long long hi = std::min(n, lo + Export_Segment - 1);
+            auto part = util::mem<uint64_t>::wrap(cache.ptr() + lo / 64, (hi - lo) / 64 + 1);
+            sieve_window(lo, hi, part, th, seg);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        auto ns = (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        std::cout << "Calculation time: " << ns / 1'000'000 << "ms " << ns % 1'000'000 << "ns\n";
+        std::cout << "\n";
+
+        bool ok = true;
+        if (mode == (int)output::Heatmap)
+        {
+            long long block = ulam::heatmap("spiral_heat.bmp", n, cache.ptr(), heat_side(), th);
+            ok = block > 0;
+            if (ok) { std::cout << "Cells per pixel:  " << block << " x " << block << "\n"; }
+        }
+        else
+        {
+            ok = spiral_output(mode, n, ulam::bit_levels{ cache.ptr(), n }, th);
+        }
+        if (!ok)
+        {
+            std::cerr
+                << ANSI::b_red << "Cannot write image"
+                << ANSI::reset << "\n";
+            cache.close();
+            std::remove(Spiral_Cache);
+            return 6;
+        }
+        cache.close();
+    }
+    catch (std::bad_alloc const&)
+    {
+        std::cerr
+            << ANSI::b_red << "Cannot allocate memory for image"
+            << ANSI::reset << "\n";
+        std::remove(Spiral_Cache);
+        return 5;
+    }
+    catch (i_op::error_msg const& e)
+    {
+        std::cerr << e << "\n";
+        std::remove(Spiral_Cache);
+        return 6;
+    }
+
+    std::remove(Spiral_Cache);
+    return 0;
+}
+
 
 /* ========================================================================================================= */
 /* This program again uses i_op API and stdlib, so it should work under both Win32 and Linux. Because of how */
@@ -42,11 +657,75 @@ int main(int argc, char const* argv[])
             << ANSI::reset << "- upper bound of searched range\n"
             << ANSI::b_green << "            type "
             << ANSI::reset << "- 0 for silent output (only time measures), 1 for text output, 2 for image output"
-            << " (careful — for n = 2e8 image output is approximately 0.5 GB! Output for n above is not allowed)\n"
+            << " (careful — for n = 2e8 image output is approximately 0.2 GB! Above that, spiral is rendered through"
+            << " spiral.cache file of n / 8 bytes),"
+            << " 3 for prime list export to primes.gaps (varint-encoded gaps, streamed - any n allowed),"
+            << " 4 for prime list to stdout, one per line (streamed - any n allowed, time measures go to stderr),"
+            << " 5 for Ulam Spiral as tile pyramid in spiral_tiles/<level>/<x>_<y>.bmp (any n allowed),"
+            << " 6 for prime density heatmap of Ulam Spiral in spiral_heat.bmp (fixed size - any n allowed),"
+            << " 7 for image output as tiled BigTIFF in spiral.tif (1 or 8 bit, not bound by 4 GB limit of bmp)\n"
             << ANSI::b_green << "     max threads "
-            << ANSI::reset << "- max limit of threads that will be spawned or -1 for equal to CPU count\n";
+            << ANSI::reset << "- max limit of threads that will be spawned or -1 for equal to CPU count\n"
+            << ANSI::b_blue << "PRIME_STRATEGY=atkin "
+            << ANSI::reset << "- environment variable that selects segmented Sieve of Atkin instead of Eratosthenes\n"
+            << ANSI::b_blue << "PRIME_BMP_DEPTH=1|8|24 "
+            << ANSI::reset << "- environment variable that selects bits per pixel of image output (default 8 - palettized gray)\n"
+            << ANSI::b_blue << "PRIME_LAYOUT=ulam|sacks|klauber "
+            << ANSI::reset << "- environment variable that selects layout of text and image output (default ulam - spiral.*,"
+            << " sacks - anti-aliased Sacks spiral in sacks.bmp, image only, klauber - Klauber triangle in klauber.*)\n"
+            << ANSI::b_blue << "PRIME_HEAT_SIDE=<pixels> "
+            << ANSI::reset << "- environment variable that selects max side of heatmap (default " << Heat_Side << ")\n"
+            << ANSI::b_blue << "PRIME_PIXEL_BUDGET=<pixels> "
+            << ANSI::reset << "- environment variable that selects max pixels of Ulam Spiral image, above which <type> 2"
+            << " writes heatmap instead (default " << Pixel_Budget << ")\n"
+            << ANSI::b_blue << "PRIME_NO_TUNE=1 "
+            << ANSI::reset << "- environment variable that disables per-host profile (calibrated on first run with -1 threads)\n"
+            << ANSI::b_blue << "PRIME_NO_RING=1 "
+            << ANSI::reset << "- environment variable that makes file output use thread pool instead of io_uring\n"
+            << ANSI::b_yellow << "Cluster mode: " << argv[0] << " coordinator [socket] [n] ..."
+            << ANSI::reset << " / "
+            << ANSI::b_yellow << argv[0] << " worker [socket] ..."
+            << ANSI::reset << " - run without further args for details\n"
+            << ANSI::b_yellow << "Query daemon: " << argv[0] << " serve [socket] [n] ..."
+            << ANSI::reset << " / "
+            << ANSI::b_yellow << argv[0] << " query [socket] [request...]"
+            << ANSI::reset << " - run without further args for details\n"
+            << ANSI::b_yellow << "Spiral diagonals: " << argv[0] << " diagonals [K] ..."
+            << ANSI::reset << " - run without further args for details\n";
         return 1;
     }
+
+    /* ======================================================= */
+    /* Dispatch cluster mode - worker processes or coordinator */
+    /* ======================================================= */
+    if ("coordinator"s == argv[1])
+    {
+        return coordinator_main(argc, argv);
+    }
+    if ("worker"s == argv[1])
+    {
+        return worker_main(argc, argv);
+    }
+
+    /* ============================================= */
+    /* Dispatch query daemon, or its one-shot client */
+    /* ============================================= */
+    if ("serve"s == argv[1])
+    {
+        return serve_main(argc, argv);
+    }
+    if ("query"s == argv[1])
+    {
+        return query_main(argc, argv);
+    }
+
+    /* ========================================== */
+    /* Dispatch prime density of spiral diagonals */
+    /* ========================================== */
+    if ("diagonals"s == argv[1])
+    {
+        return diagonals_main(argc, argv);
+    }
     
     /* ================================================================================================ */
     /* Parse required parameter - positive long integer that represents upper bound of calculated range */
@@ -67,21 +746,13 @@ int main(int argc, char const* argv[])
     if (argc >= 3)
     {
         mode = std::atoi(argv[2]);
-        if (0 > mode || mode > 2)
+        if (0 > mode || mode > 7)
         {
             std::cerr
-                << ANSI::b_red << "<type>s allowed: 0 - no output, 1 - text output, 2 - image output"
+                << ANSI::b_red << "<type>s allowed: 0 - no output, 1 - text output, 2 - image output, 3 - prime list export, 4 - prime list to stdout, 5 - tile pyramid, 6 - heatmap, 7 - tiled image"
                 << ANSI::reset << "\n";
             return 3;
         }
-        if (n > (long long)2e8 && mode != 0)
-        {
-
-            std::cerr
-                << ANSI::b_red << "Outputting ranges above 2e8 is not allowed for stability reasons"
-                << ANSI::reset << "\n";
-            return 4;
-        }
     }
     
     /* ============================================= */
@@ -102,11 +773,85 @@ int main(int argc, char const* argv[])
     if (getenv("PRIME_SINGLE_THREAD") != nullptr && "1"s == getenv("PRIME_SINGLE_THREAD"))
     {
         th = 1;
-        std::cout
+        /// list goes to stdout, so it must stay clean
+        (mode == (int)output::List ? std::cerr : std::cout)
             << ANSI::b_blue << "Override of <max threads> via environment variable. "
             << ANSI::reset << "New value := 1" << "\n";
     }
 
+    if ((mode == (int)output::Text || mode == (int)output::Tiff) && spiral_layout() == layout::Sacks)
+    {
+        std::cerr
+            << ANSI::b_red << "Sacks spiral has no text or tiled output - use <type> 2"
+            << ANSI::reset << "\n";
+        return 3;
+    }
+
+    /* ========================================================================================== */
+    /* Ulam Spiral with more cells than pixel budget is shown as density heatmap, where pixel     */
+    /* stands for block of cells - instead of image too large to be viewed (or even saved as bmp) */
+    /* ========================================================================================== */
+    if (mode == (int)output::Image && spiral_layout() == layout::Ulam && ulam::side_of(n) * ulam::side_of(n) > pixel_budget())
+    {
+        mode = (int)output::Heatmap;
+        std::cout
+            << ANSI::b_blue << "Spiral exceeds pixel budget. "
+            << ANSI::reset << "Writing heatmap to spiral_heat.bmp instead (<type> 7 keeps full resolution)" << "\n";
+    }
+
+    /* ============================================================================= */
+    /* Detect sieving algorithm override - Sieve of Atkin is selected for comparison */
+    /* ============================================================================= */
+    bool atkin = getenv("PRIME_STRATEGY") != nullptr && "atkin"s == getenv("PRIME_STRATEGY");
+
+    /* ===================================================================================== */
+    /* Detect io_uring override - file output falls back to thread pool of positional writes */
+    /* ===================================================================================== */
+    util::use_ring = !(getenv("PRIME_NO_RING") != nullptr && "1"s == getenv("PRIME_NO_RING"));
+
+    /* ============================================================================================= */
+    /* Load tuned configuration of this host (calibrating on first run), unless thread count is set  */
+    /* explicitly or tuning is disabled. Calibration messages go to stderr, to keep stdout parseable */
+    /* ============================================================================================= */
+    long long seg = 0;
+    if (th == -1 && !(getenv("PRIME_NO_TUNE") != nullptr && "1"s == getenv("PRIME_NO_TUNE")))
+    {
+        auto profile = tuning::get(std::cerr);
+        th = n < profile.crossover ? 1 : profile.threads;
+        seg = profile.segment;
+    }
+
+    if (mode == (int)output::Gaps)
+    {
+        return export_gaps(n, th, seg);
+    }
+    if (mode == (int)output::List)
+    {
+        return export_list(n, th, seg);
+    }
+    if (mode == (int)output::Tiles)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        int levels = ulam::pyramid("spiral_tiles", n, th);
+        auto end = std::chrono::high_resolution_clock::now();
+        auto ns = (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+        if (levels < 0)
+        {
+            std::cerr
+                << ANSI::b_red << "Cannot write tiles to spiral_tiles"
+                << ANSI::reset << "\n";
+            return 6;
+        }
+
+        std::cout << "Levels written:   " << levels << "\n";
+        std::cout << "Calculation time: " << ns / 1'000'000 << "ms " << ns % 1'000'000 << "ns\n";
+        return 0;
+    }
+    if (mode == (int)output::Heatmap || ((mode == (int)output::Text || mode == (int)output::Image || mode == (int)output::Tiff) && n > Spiral_In_Core_Limit))
+    {
+        return spiral_out_of_core(n, mode, th, seg);
+    }
 
     auto sieve = util::mem<char>::calloc(n + 1);
     if (sieve.ptr() == nullptr)
@@ -120,17 +865,39 @@ int main(int argc, char const* argv[])
     /* ===================================================================================== */
     /* Sieve numbers, print time measures - in no output mode show total time in nanoseconds */
     /* ===================================================================================== */
-    if (th == 1)
+    bool narrow = n < sieving_strategy::Narrow_Limit;
+    if (atkin)
     {
         if (mode == (int)output::None)
         {
-            auto stopwatch = sieving_strategy::single_thread(n, sieve);
+            auto stopwatch = sieving_strategy::atkin(n, sieve, th);
+            long long total_ns = stopwatch.ns_i + stopwatch.ns_sc + stopwatch.ns_mc;
+            std::cout << "  " << total_ns << "  \n";
+        }
+        else
+        {
+            auto stopwatch = sieving_strategy::atkin(n, sieve, th);
+            std::cout << "Init time:        " << stopwatch.ms_i << "ms " << stopwatch.ns_i % 1'000'000 << "ns\n";
+            std::cout << "Precalc time:     " << stopwatch.ms_sc << "ms " << stopwatch.ns_sc % 1'000'000 << "ns\n";
+            std::cout << "Calculation time: " << stopwatch.ms_mc << "ms " << stopwatch.ns_mc % 1'000'000 << "ns\n";
+            std::cout << "\n";
+        }
+    }
+    else if (th == 1)
+    {
+        if (mode == (int)output::None)
+        {
+            auto stopwatch = narrow ?
+                sieving_strategy::single_thread<uint32_t>(n, sieve) :
+                sieving_strategy::single_thread<long long>(n, sieve);
             long long total_ns = stopwatch.ns_i + stopwatch.ns_sc;
             std::cout << "  " << total_ns << "  \n";
         }
         else
         {
-            auto stopwatch = sieving_strategy::single_thread(n, sieve);
+            auto stopwatch = narrow ?
+                sieving_strategy::single_thread<uint32_t>(n, sieve) :
+                sieving_strategy::single_thread<long long>(n, sieve);
             std::cout << "Init time:        " << stopwatch.ms_i << "ms " << stopwatch.ns_i % 1'000'000 << "ns\n";
             std::cout << "Calculation time: " << stopwatch.ms_sc << "ms " << stopwatch.ns_sc % 1'000'000 << "ns\n";
             std::cout << "\n";
@@ -140,13 +907,17 @@ int main(int argc, char const* argv[])
     {
         if (mode == (int)output::None)
         {
-            auto stopwatch = sieving_strategy::multi_thread(n, sieve, th);
+            auto stopwatch = narrow ?
+                sieving_strategy::multi_thread<uint32_t>(n, sieve, th, seg) :
+                sieving_strategy::multi_thread<long long>(n, sieve, th, seg);
             long long total_ns = stopwatch.ns_i + stopwatch.ns_sc + stopwatch.ns_mc;
             std::cout << "  " << total_ns << "  \n";
         }
         else
         {
-            auto stopwatch = sieving_strategy::multi_thread(n, sieve, th);
+            auto stopwatch = narrow ?
+                sieving_strategy::multi_thread<uint32_t>(n, sieve, th, seg) :
+                sieving_strategy::multi_thread<long long>(n, sieve, th, seg);
             std::cout << "Init time:        " << stopwatch.ms_i << "ms " << stopwatch.ns_i % 1'000'000 << "ns\n";
             std::cout << "Precalc time:     " << stopwatch.ms_sc << "ms " << stopwatch.ns_sc % 1'000'000 << "ns\n";
             std::cout << "Calculation time: " << stopwatch.ms_mc << "ms " << stopwatch.ns_mc % 1'000'000 << "ns\n";
@@ -158,13 +929,25 @@ int main(int argc, char const* argv[])
     /* =============================== */
     /* Output Ulam Spiral, if selected */
     /* =============================== */
-    if (mode == (int)output::Text)
-    {
-        ulam::print("spiral.txt", sieve);
-    }
-    else if (mode == (int)output::Image)
+    if (mode == (int)output::Text || mode == (int)output::Image || mode == (int)output::Tiff)
     {
-        ulam::picture("spiral.bmp", sieve);
+        try
+        {
+            if (!spiral_output(mode, n, ulam::char_levels{ sieve.ptr(), (long long)sieve.len() }, th))
+            {
+                std::cerr
+                    << ANSI::b_red << "Cannot write image"
+                    << ANSI::reset << "\n";
+                sieve.free();
+                return 6;
+            }
+        }
+        catch (i_op::error_msg const& e)
+        {
+            std::cerr << e << "\n";
+            sieve.free();
+            return 6;
+        }
     }
 
     sieve.free();
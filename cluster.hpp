@@ -0,0 +1,436 @@
+#pragma once
+
+#include <iostream>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <deque>
+#include <new>
+#include <optional>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include "interoperability/socket.hpp"
+#include "interoperability/thread.hpp"
+#include "interoperability/process.hpp"
+#include "util/memory.hpp"
+#include "util/ansi_text.hpp"
+#include "sieving_strategies.hpp"
+
+/* ======================================================================================================== */
+/* Coordinator/worker mode - coordinator splits range into chunks, which are handed out to worker processes */
+/* connected over local socket. Workers pull next chunk as soon as they return result of previous one, so   */
+/* faster workers simply take more chunks. Chunk held by worker that disconnects (or does not return result */
+/* within timeout, then it is disconnected) is put back in front of queue.                                  */
+/*                                                                                                          */
+/* Protocol is stream of messages, each beginning with fixed, 32-byte little-endian header:                 */
+/*     uint32 magic ("SO2C"), uint32 type, uint64 a, uint64 b, uint64 payload length (bytes)                */
+/* followed by payload. Nothing in it depends on transport, so TCP can carry it unchanged.                  */
+/* ======================================================================================================== */
+namespace cluster
+{
+    typedef long long llong;
+
+    /// @brief Value of first field of every header - "SO2C" in little-endian
+    constexpr uint32_t Magic = 0x43324f53;
+    /// @brief Size of message header in bytes
+    constexpr size_t Header_Size = 32;
+    /// @brief Default time, in which worker must return result of its chunk
+    constexpr int Chunk_Timeout_Ms = 600'000;
+
+    /**
+     * @brief Types of messages
+     */
+    enum struct msg : uint32_t
+    {
+        /// @brief Coordinator -> worker: sieve `a`..`b` (inclusive), reply with `Result_Count`
+        Range_Count = 1,
+        /// @brief Coordinator -> worker: sieve `a`..`b` (inclusive), reply with `Result_Bits`
+        Range_Bits = 2,
+        /// @brief Worker -> coordinator: `b` primes found in range starting at `a`
+        Result_Count = 3,
+        /// @brief Worker -> coordinator: `b` primes found in range starting at `a`, payload is `storage::bit`
+        /// sieve of that range, beginning at `a` rounded down to multiple of 64
+        Result_Bits = 4,
+        /// @brief Coordinator -> worker: no more work, disconnect
+        Shutdown = 5
+    };
+
+    struct header
+    {
+        msg type;
+        uint64_t a;
+        uint64_t b;
+        uint64_t payload;
+    };
+
+    /**
+     * @return `true` if host stores numbers in little-endian order - then words are sent as they are
+     */
+    inline bool little_endian()
+    {
+        uint16_t word = 0x0001;
+        return *(uint8_t*)&word == 1;
+    }
+
+    inline void put_le(uint8_t* _buf, uint64_t _val, int _bytes)
+    {
+        for (int i = 0; i < _bytes; i++) { _buf[i] = (uint8_t)(_val >> (8 * i)); }
+    }
+
+    inline uint64_t get_le(uint8_t const* _buf, int _bytes)
+    {
+        uint64_t val = 0;
+        for (int i = 0; i < _bytes; i++) { val |= (uint64_t)_buf[i] << (8 * i); }
+        return val;
+    }
+
+    /**
+     * @throw i_op::error_msg – if sending fails
+     */
+    void send_header(i_op::local_socket& _sock, header const& _h)
+    {
+        uint8_t buf[Header_Size];
+        put_le(buf, Magic, 4);
+        put_le(buf + 4, (uint32_t)_h.type, 4);
+        put_le(buf + 8, _h.a, 8);
+        put_le(buf + 16, _h.b, 8);
+        put_le(buf + 24, _h.payload, 8);
+        _sock.send(buf, Header_Size);
+    }
+
+    /**
+     * @return `false` if connection was closed, or peer does not speak this protocol
+     * @throw i_op::error_msg – if receiving fails
+     */
+    bool receive_header(i_op::local_socket& _sock, header& _h)
+    {
+        uint8_t buf[Header_Size];
+        if (!_sock.receive(buf, Header_Size)) { return false; }
+        if (get_le(buf, 4) != Magic) { return false; }
+        _h.type = (msg)get_le(buf + 4, 4);
+        _h.a = get_le(buf + 8, 8);
+        _h.b = get_le(buf + 16, 8);
+        _h.payload = get_le(buf + 24, 8);
+        return true;
+    }
+
+    /**
+     * @brief Sends `_n` words as little-endian payload
+     */
+    void send_words(i_op::local_socket& _sock, uint64_t const* _words, size_t _n)
+    {
+        if (little_endian())
+        {
+            _sock.send(_words, _n * sizeof(uint64_t));
+            return;
+        }
+        std::vector<uint8_t> buf(_n * sizeof(uint64_t));
+        for (size_t i = 0; i < _n; i++) { put_le(buf.data() + i * 8, _words[i], 8); }
+        _sock.send(buf.data(), buf.size());
+    }
+
+    /**
+     * @brief Receives `_n` words of little-endian payload
+     *
+     * @return `false` if connection was closed
+     */
+    bool receive_words(i_op::local_socket& _sock, uint64_t* _words, size_t _n)
+    {
+        if (!_sock.receive(_words, _n * sizeof(uint64_t))) { return false; }
+        if (!little_endian())
+        {
+            for (size_t i = 0; i < _n; i++) { _words[i] = get_le((uint8_t const*)&_words[i], 8); }
+        }
+        return true;
+    }
+
+
+
+    /**
+     * @brief Connects to coordinator listening on `_path`, and sieves ranges it sends until told to stop.
+     *
+     * Connection is retried for a few seconds, so that workers may be started before coordinator. Malformed
+     * range, or one that cannot be held in memory, ends connection - so that coordinator hands it to another worker.
+     *
+     * @param _th max threads used for every range (-1 for all available)
+     * @param _log stream for progress messages
+     * @return `0` on orderly shutdown, `1` if coordinator could not be reached
+     */
+    int worker(char const* _path, int _th, std::ostream& _log)
+    {
+        std::optional<i_op::local_socket> sock;
+        for (int attempt = 0; !sock; attempt++)
+        {
+            try
+            {
+                sock.emplace(i_op::local_socket::connect(_path));
+            }
+            catch (i_op::error_msg const& e)
+            {
+                if (attempt == 50)
+                {
+                    _log << e;
+                    return 1;
+                }
+                i_op::thread::sleep(100_tu_ms);
+            }
+        }
+
+        _log
+            << ANSI::b_green << "Worker " << i_op::process::get_current_pid() << " connected to "
+            << ANSI::reset << _path << "\n";
+
+        try
+        {
+            header h{};
+            while (receive_header(*sock, h) && (h.type == msg::Range_Count || h.type == msg::Range_Bits))
+            {
+                /* ========================================================================================= */
+                /* Window is sieved as bit storage starting at word boundary - count skips numbers below `a` */
+                /* ========================================================================================= */
+                if (h.a > h.b || h.b > (uint64_t)LLONG_MAX - 64)
+                {
+                    _log << ANSI::b_red << "Malformed range " << ANSI::reset << h.a << ".." << h.b << "\n";
+                    break;
+                }
+                llong lo = (llong)h.a;
+                llong hi = (llong)h.b;
+                llong base = lo & ~63LL;
+                auto bits = util::mem<uint64_t>::calloc((hi - base) / 64 + 1);
+                if (bits.ptr() == nullptr)
+                {
+                    _log << ANSI::b_red << "Cannot allocate memory for range " << ANSI::reset << lo << ".." << hi << "\n";
+                    break;
+                }
+
+                if (hi < sieving_strategy::Narrow_Limit)
+                {
+                    sieving_strategy::window<uint32_t, sieving_strategy::storage::bit>(base, hi, bits, _th);
+                }
+                else
+                {
+                    sieving_strategy::window<llong, sieving_strategy::storage::bit>(base, hi, bits, _th);
+                }
+                llong cnt = sieving_strategy::storage::bit::count(bits.ptr(), lo - base, hi - base);
+
+                if (h.type == msg::Range_Count)
+                {
+                    send_header(*sock, header{ msg::Result_Count, (uint64_t)lo, (uint64_t)cnt, 0 });
+                }
+                else
+                {
+                    /// numbers past `hi` in last word were never sieved - they are marked as composite
+                    if (((hi - base) & 63) != 63) { bits.ptr()[bits.len() - 1] |= ~(uint64_t)0 << (((hi - base) & 63) + 1); }
+
+                    send_header(*sock, header{ msg::Result_Bits, (uint64_t)lo, (uint64_t)cnt, bits.len() * sizeof(uint64_t) });
+                    send_words(*sock, bits.ptr(), bits.len());
+                }
+                bits.free();
+            }
+        }
+        catch (i_op::error_msg const& e)
+        {
+            _log << e << "\n";
+        }
+
+        sock.reset();
+        _log
+            << ANSI::b_blue << "Worker " << i_op::process::get_current_pid() << " finished"
+            << ANSI::reset << "\n";
+        return 0;
+    }
+
+
+
+    /**
+     * @brief Outcome of coordinated calculation
+     */
+    struct result
+    {
+        /// @brief Count of primes in requested range
+        llong count;
+        /// @brief Number kept at bit 0 of `bits` - requested lower bound rounded down to multiple of 64
+        llong base;
+        /// @brief `storage::bit` sieve of whole range, if it was requested (empty otherwise)
+        util::mem<uint64_t> bits;
+    };
+
+    /**
+     * @brief Worker connection, and chunk it is currently working on
+     */
+    struct peer
+    {
+        i_op::local_socket sock;
+        bool busy;
+        std::pair<llong, llong> range;
+        /// @brief Time when chunk was handed out
+        std::chrono::steady_clock::time_point since;
+    };
+
+    /**
+     * @brief Listens on `_path`, and distributes range `_lo`..`_hi` (inclusive) between connected workers, in
+     * chunks of `_chunk` numbers. Returns once every chunk has its result - workers may come and go meanwhile,
+     * chunk of lost worker is handed to next idle one.
+     *
+     * @param _bits whether workers should return sieves of their chunks, instead of counts only
+     * @param _log stream for progress messages
+     * @param _timeout_ms time, in which worker must return result of chunk - it is disconnected otherwise, and
+     *      chunk is handed to another one
+     * @throw i_op::error_msg – if listening socket cannot be created
+     * @throw std::bad_alloc – if memory for sieve of range cannot be allocated
+     */
+    result coordinator(char const* _path, llong _lo, llong _hi, llong _chunk, bool _bits, std::ostream& _log, int _timeout_ms = Chunk_Timeout_Ms)
+    {
+        result res{ 0, _lo & ~63LL, util::mem<uint64_t>::wrap(nullptr, 0) };
+        _chunk = std::max(64LL, (_chunk + 63) & ~63LL);
+
+        /* ========================================================================================= */
+        /* Chunks begin on multiples of 64 (past first one), so that sieves returned by workers fill */
+        /* whole words of result                                                                     */
+        /* ========================================================================================= */
+        std::deque<std::pair<llong, llong>> pending;
+        for (llong s = res.base; s <= _hi; s += _chunk)
+        {
+            pending.push_back({ std::max(s, _lo), std::min(s + _chunk - 1, _hi) });
+        }
+        size_t total = pending.size();
+        size_t completed = 0;
+
+        if (_bits)
+        {
+            res.bits = util::mem<uint64_t>::calloc((_hi - res.base) / 64 + 1);
+            if (res.bits.ptr() == nullptr) { throw std::bad_alloc(); }
+        }
+
+        auto listener = i_op::local_socket::listen(_path);
+        std::vector<peer> peers;
+
+        _log
+            << ANSI::b_blue << "Coordinator listening on "
+            << ANSI::reset << _path << " - " << total << " chunk(s) to distribute\n";
+
+        while (completed < total)
+        {
+            /* ===================================================== */
+            /* Hand out chunks to idle workers, then wait for events */
+            /* ===================================================== */
+            for (auto& p : peers)
+            {
+                if (p.busy || pending.empty()) { continue; }
+                p.range = pending.front();
+                pending.pop_front();
+                p.busy = true;
+                p.since = std::chrono::steady_clock::now();
+                try
+                {
+                    send_header(p.sock, header{ _bits ? msg::Range_Bits : msg::Range_Count, (uint64_t)p.range.first, (uint64_t)p.range.second, 0 });
+                }
+                catch (i_op::error_msg const&)
+                {
+                    /// failure will be noticed as hang-up by `wait_readable`
+                }
+            }
+
+            /* =========================================================================== */
+            /* Waiting ends no later than first busy worker runs out of time for its chunk */
+            /* =========================================================================== */
+            std::vector<i_op::local_socket const*> socks{ &listener };
+            auto now = std::chrono::steady_clock::now();
+            llong wait_ms = -1;
+            for (auto& p : peers)
+            {
+                socks.push_back(&p.sock);
+                if (!p.busy) { continue; }
+                llong left = _timeout_ms - std::chrono::duration_cast<std::chrono::milliseconds>(now - p.since).count();
+                wait_ms = std::max(0LL, wait_ms < 0 ? left : std::min(wait_ms, left));
+            }
+
+            std::vector<bool> lost(peers.size(), false);
+            for (size_t r : i_op::local_socket::wait_readable(socks, (int)wait_ms))
+            {
+                if (r == 0)
+                {
+                    peers.push_back(peer{ listener.accept(), false, { 0, 0 }, {} });
+                    lost.push_back(false);
+                    _log << ANSI::b_green << "Worker connected" << ANSI::reset << " (" << peers.size() << " total)\n";
+                    continue;
+                }
+
+                auto& p = peers[r - 1];
+                header h{};
+                bool ok = false;
+                try
+                {
+                    ok = receive_header(p.sock, h) && p.busy && (llong)h.a == p.range.first;
+                    if (ok && h.type == msg::Result_Count && !_bits)
+                    {
+                        res.count += (llong)h.b;
+                    }
+                    else if (ok && h.type == msg::Result_Bits && _bits)
+                    {
+                        llong first = (p.range.first & ~63LL) - res.base;
+                        size_t words = (size_t)((p.range.second - (p.range.first & ~63LL)) / 64 + 1);
+                        ok = h.payload == words * sizeof(uint64_t) && receive_words(p.sock, res.bits.ptr() + first / 64, words);
+                        if (ok) { res.count += (llong)h.b; }
+                    }
+                    else
+                    {
+                        ok = false;
+                    }
+                }
+                catch (i_op::error_msg const&)
+                {
+                    ok = false;
+                }
+
+                if (ok)
+                {
+                    p.busy = false;
+                    completed++;
+                }
+                else
+                {
+                    lost[r - 1] = true;
+                }
+            }
+
+            now = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < lost.size(); i++)
+            {
+                if (lost[i] || !peers[i].busy || now - peers[i].since < std::chrono::milliseconds(_timeout_ms)) { continue; }
+                _log << ANSI::b_yellow << "Worker timed out" << ANSI::reset << "\n";
+                lost[i] = true;
+            }
+
+            /* ==================================================================== */
+            /* Drop lost workers - chunks they were working on go back to the front */
+            /* ==================================================================== */
+            for (size_t i = peers.size(); i-- > 0;)
+            {
+                if (!lost[i]) { continue; }
+                if (peers[i].busy)
+                {
+                    pending.push_front(peers[i].range);
+                    _log
+                        << ANSI::b_yellow << "Worker lost, reassigning "
+                        << ANSI::reset << peers[i].range.first << ".." << peers[i].range.second << "\n";
+                }
+                else
+                {
+                    _log << ANSI::b_yellow << "Worker disconnected" << ANSI::reset << "\n";
+                }
+                peers.erase(peers.begin() + i);
+            }
+        }
+
+        for (auto& p : peers)
+        {
+            try { send_header(p.sock, header{ msg::Shutdown, 0, 0, 0 }); }
+            catch (i_op::error_msg const&) {}
+        }
+
+        return res;
+    }
+}
@@ -0,0 +1,498 @@
+/* ========================================================================== */
+/* Author: Marcin Jeznach || plz no steal 😭                                  */
+/*                                                                            */
+/* File written asynchronously at explicit offsets, with OS-independent       */
+/* interface. On Linux writes are submitted through io_uring (set up with raw */
+/* system calls, so no liburing is needed), and if kernel refuses it, or      */
+/* cannot write through it - they are handed to small pool of threads, each   */
+/* doing plain positional writes. Win32 always uses the thread pool.          */
+/* ========================================================================== */
+#pragma once
+#include "./macro.hpp"
+
+#ifdef OS_WIN32
+#include <windows.h>
+#endif
+#ifdef OS_LINUX
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "./error_msg.hpp"
+#include "./semaphore.hpp"
+#include "./thread.hpp"
+
+namespace i_op
+{
+    /**
+     * @brief File opened for writing, that accepts up to `slots()` writes in flight at once. Every write is
+     *      bound to slot, and its memory must stay untouched until slot is waited for. Objects are neither
+     *      copyable, nor movable
+     */
+    class async_file final
+    {
+    private:
+        /**
+         * @brief Single write in flight - remaining part of it, if it was done partially
+         */
+        struct request
+        {
+            async_file* owner{ nullptr };
+            uint8_t const* data{ nullptr };
+            size_t len{ 0 };
+            uint64_t offset{ 0 };
+            /// @brief OS-specific error code of failed write, 0 if none
+            long err{ 0 };
+            bool busy{ false };
+            /// @brief Worker thread of fallback pool - started on first write of slot
+            bool started{ false };
+            bool stop{ false };
+            i_op::semaphore go{ 0 };
+            i_op::semaphore done{ 0 };
+            i_op::thread worker{ nullptr };
+        };
+
+        std::vector<std::unique_ptr<request>> __slots;
+        bool __ring_allowed;
+#ifdef OS_WIN32
+        HANDLE __fl_hdl{ INVALID_HANDLE_VALUE };
+#endif
+#ifdef OS_LINUX
+        int __fl_dtr{ -1 };
+        /// @brief io_uring instance, -1 until first write (or for good, if it could not be set up)
+        int __ring{ -1 };
+        bool __ring_tried{ false };
+        void* __sq_map{ nullptr };
+        size_t __sq_map_len{ 0 };
+        void* __cq_map{ nullptr };
+        size_t __cq_map_len{ 0 };
+        io_uring_sqe* __sqes{ nullptr };
+        size_t __sqes_len{ 0 };
+        unsigned* __sq_tail{ nullptr };
+        unsigned* __sq_mask{ nullptr };
+        unsigned* __sq_array{ nullptr };
+        unsigned* __cq_head{ nullptr };
+        unsigned* __cq_tail{ nullptr };
+        unsigned* __cq_mask{ nullptr };
+        io_uring_cqe* __cqes{ nullptr };
+#endif
+
+
+        /**
+         * @brief Writes whole `_len` bytes at `_offset`, repeating partial writes
+         *
+         * @return 0 on success, OS-specific error code otherwise
+         */
+        inline long write_all(uint8_t const* _data, size_t _len, uint64_t _offset) noexcept
+        {
+            while (_len > 0)
+            {
+#ifdef OS_WIN32
+                OVERLAPPED at{};
+                at.Offset = (DWORD)_offset;
+                at.OffsetHigh = (DWORD)(_offset >> 32);
+                DWORD done{ 0 };
+                DWORD chunk = _len > (1u << 30) ? (1u << 30) : (DWORD)_len;
+                if (!!WriteFile(this->__fl_hdl, _data, chunk, &done, &at) == false) { return GetLastError(); }
+#endif
+#ifdef OS_LINUX
+                ssize_t done = pwrite(this->__fl_dtr, _data, _len, (off_t)_offset);
+                if (done < 0 && errno == EINTR) { continue; }
+                if (done < 0) { return errno; }
+#endif
+                if (done == 0) { return EIO; }
+                _data += done;
+                _len -= done;
+                _offset += done;
+            }
+            return 0;
+        }
+
+        /**
+         * @brief Body of fallback pool thread - writes requests of its slot, until it is stopped
+         */
+        static auto work(void* _arg)
+        {
+            request* req = (request*)_arg;
+            for (;;)
+            {
+                req->go.acquire();
+                if (req->stop) { break; }
+                req->err = req->owner->write_all(req->data, req->len, req->offset);
+                req->done.release();
+            }
+            return i_op::thread::OS_Runnable_OK;
+        }
+
+#ifdef OS_LINUX
+        /**
+         * @brief Checks whether io_uring `_fd` supports `IORING_OP_WRITE` - kernels 5.1-5.5 set up rings, but
+         *      fail every such write with `EINVAL`. Those also lack probing, so failed probe means no support
+         */
+        static bool ring_writes(int _fd) noexcept
+        {
+            constexpr unsigned Ops = 256;
+            alignas(io_uring_probe) uint8_t buf[sizeof(io_uring_probe) + Ops * sizeof(io_uring_probe_op)]{};
+            io_uring_probe* probe = (io_uring_probe*)buf;
+            if (syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PROBE, probe, Ops) < 0) { return false; }
+            return probe->last_op >= IORING_OP_WRITE && (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED) != 0;
+        }
+
+        /**
+         * @brief Creates io_uring instance and maps its rings. On failure (or if kernel cannot write through it)
+         *      leaves `__ring` at -1, so that thread pool is used instead
+         */
+        inline void ring_setup() noexcept
+        {
+            this->__ring_tried = true;
+            io_uring_params p{};
+            int fd = (int)syscall(__NR_io_uring_setup, (unsigned)this->__slots.size(), &p);
+            if (fd < 0) { return; }
+            if (!ring_writes(fd))
+            {
+                ::close(fd);
+                return;
+            }
+
+            this->__sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            this->__cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+            bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single)
+            {
+                this->__sq_map_len = this->__cq_map_len = std::max(this->__sq_map_len, this->__cq_map_len);
+            }
+            this->__sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+
+            void* sq = mmap(nullptr, this->__sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+            void* cq = single || sq == MAP_FAILED ? sq : mmap(nullptr, this->__cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            void* sqes = mmap(nullptr, this->__sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+            if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED)
+            {
+                if (sqes != MAP_FAILED) { munmap(sqes, this->__sqes_len); }
+                if (cq != MAP_FAILED && !single) { munmap(cq, this->__cq_map_len); }
+                if (sq != MAP_FAILED) { munmap(sq, this->__sq_map_len); }
+                ::close(fd);
+                return;
+            }
+
+            this->__sq_map = sq;
+            this->__cq_map = cq;
+            this->__sqes = (io_uring_sqe*)sqes;
+            this->__sq_tail = (unsigned*)((char*)sq + p.sq_off.tail);
+            this->__sq_mask = (unsigned*)((char*)sq + p.sq_off.ring_mask);
+            this->__sq_array = (unsigned*)((char*)sq + p.sq_off.array);
+            this->__cq_head = (unsigned*)((char*)cq + p.cq_off.head);
+            this->__cq_tail = (unsigned*)((char*)cq + p.cq_off.tail);
+            this->__cq_mask = (unsigned*)((char*)cq + p.cq_off.ring_mask);
+            this->__cqes = (io_uring_cqe*)((char*)cq + p.cq_off.cqes);
+            this->__ring = fd;
+        }
+
+        /**
+         * @brief Queues (remaining part of) request of slot `_slot` in io_uring, and submits it
+         * @throw i_op::error_msg – contains OS-specific error code
+         */
+        inline void ring_submit(unsigned _slot) noexcept(false)
+        {
+            request& req = *this->__slots[_slot];
+
+            /* ================================================================== */
+            /* Only this thread produces entries, so tail needs no atomic reading */
+            /* ================================================================== */
+            unsigned tail = *this->__sq_tail;
+            unsigned idx = tail & *this->__sq_mask;
+            io_uring_sqe* sqe = &this->__sqes[idx];
+            *sqe = io_uring_sqe{};
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->fd = this->__fl_dtr;
+            sqe->addr = (uint64_t)(uintptr_t)req.data;
+            sqe->len = req.len > (1u << 30) ? (1u << 30) : (uint32_t)req.len;
+            sqe->off = req.offset;
+            sqe->user_data = _slot;
+            this->__sq_array[idx] = idx;
+            __atomic_store_n(this->__sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+            while (syscall(__NR_io_uring_enter, this->__ring, 1, 0, 0, nullptr, 0) < 0)
+            {
+                if (errno == EINTR) { continue; }
+                throw i_op::error_msg{ errno, "i_op::async_file::write(unsigned, void const*, size_t, uint64_t)", "io_uring_enter(unsigned, unsigned, unsigned, unsigned, sigset_t*)" };
+            }
+        }
+
+        /**
+         * @brief Waits for single completion of io_uring, and either finishes its slot or resubmits remaining
+         *      part of partial write
+         * @throw i_op::error_msg – contains OS-specific error code
+         */
+        inline void ring_reap() noexcept(false)
+        {
+            unsigned head = *this->__cq_head;
+            while (head == __atomic_load_n(this->__cq_tail, __ATOMIC_ACQUIRE))
+            {
+                if (syscall(__NR_io_uring_enter, this->__ring, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+                {
+                    throw i_op::error_msg{ errno, "i_op::async_file::wait(unsigned)", "io_uring_enter(unsigned, unsigned, unsigned, unsigned, sigset_t*)" };
+                }
+            }
+            io_uring_cqe cqe = this->__cqes[head & *this->__cq_mask];
+            __atomic_store_n(this->__cq_head, head + 1, __ATOMIC_RELEASE);
+
+            request& req = *this->__slots[cqe.user_data];
+            if (cqe.res < 0 && cqe.res != -EINTR && cqe.res != -EAGAIN) { req.err = -cqe.res; }
+            else if (cqe.res == 0 && req.len > 0) { req.err = EIO; }
+            else if (cqe.res > 0)
+            {
+                req.data += cqe.res;
+                req.len -= cqe.res;
+                req.offset += cqe.res;
+            }
+
+            if (req.err != 0 || req.len == 0) { req.busy = false; }
+            else { this->ring_submit((unsigned)cqe.user_data); }
+        }
+#endif
+
+
+    public:
+        async_file(async_file const&) = delete;
+        async_file& operator =(async_file const&) = delete;
+
+        /**
+         * @brief Creates (or truncates) file at `_path`. Neither io_uring, nor threads are created until first
+         *      asynchronous write
+         *
+         * @param _slots max count of writes in flight - must be positive
+         * @param _ring `false` forces thread pool, even if io_uring is available
+         * @throw i_op::error_msg – contains OS-specific error code
+         */
+        inline async_file(char const* _path, unsigned _slots, bool _ring = true) noexcept(false):
+            __ring_allowed(_ring)
+        {
+#ifdef OS_WIN32
+            this->__fl_hdl = CreateFileA(_path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (this->__fl_hdl == INVALID_HANDLE_VALUE)
+            {
+                throw i_op::error_msg{ GetLastError(), "i_op::async_file::async_file(char const*, unsigned, bool)", "CreateFileA(LPCSTR, DWORD, DWORD, LPSECURITY_ATTRIBUTES, DWORD, DWORD, HANDLE)" };
+            }
+#endif
+#ifdef OS_LINUX
+            this->__fl_dtr = open(_path, O_CREAT | O_WRONLY | O_TRUNC, 0664);
+            if (this->__fl_dtr < 0)
+            {
+                throw i_op::error_msg{ errno, "i_op::async_file::async_file(char const*, unsigned, bool)", "open(char const*, int, mode_t)" };
+            }
+#endif
+            for (unsigned i = 0; i < _slots; i++)
+            {
+                this->__slots.emplace_back(new request{});
+                this->__slots.back()->owner = this;
+            }
+        }
+
+
+        /**
+         * @brief Performs destruction of object, ignoring exceptions on failure
+         */
+        inline ~async_file()
+        {
+            try { this->close(); }
+            catch (i_op::error_msg const&) {}
+        }
+
+
+        /// @return max count of writes in flight
+        unsigned slots() const { return (unsigned)this->__slots.size(); }
+
+        /// @return `true` if writes go through io_uring (known only after first asynchronous write)
+        bool ring() const
+        {
+#ifdef OS_LINUX
+            return this->__ring >= 0;
+#else
+            return false;
+#endif
+        }
+
+
+        /**
+         * @brief Starts writing `_len` bytes from `_data` at `_offset` - memory must stay unchanged until `wait`
+         *      on the same slot returns
+         *
+         * @param _slot slot of write - waited for first, if it is still in flight
+         * @throw i_op::error_msg – contains OS-specific error code (also of previous write of slot)
+         */
+        inline void write(unsigned _slot, void const* _data, size_t _len, uint64_t _offset) noexcept(false)
+        {
+            this->wait(_slot);
+            request& req = *this->__slots[_slot];
+            req.data = (uint8_t const*)_data;
+            req.len = _len;
+            req.offset = _offset;
+            req.busy = true;
+
+#ifdef OS_LINUX
+            if (!this->__ring_tried && this->__ring_allowed) { this->ring_setup(); }
+            if (this->__ring >= 0)
+            {
+                this->ring_submit(_slot);
+                return;
+            }
+#endif
+            if (!req.started)
+            {
+                req.worker = i_op::thread{ &async_file::work, &req };
+                req.worker.start();
+                req.started = true;
+            }
+            req.go.release();
+        }
+
+
+        /**
+         * @brief Writes `_len` bytes from `_data` at `_offset`, returning once they are written. Uses no slot, so it
+         *      may be called from many threads at once
+         * @throw i_op::error_msg – contains OS-specific error code
+         */
+        inline void write_now(void const* _data, size_t _len, uint64_t _offset) noexcept(false)
+        {
+            long err = this->write_all((uint8_t const*)_data, _len, _offset);
+            if (err != 0)
+            {
+#ifdef OS_WIN32
+                throw i_op::error_msg{ (DWORD)err, "i_op::async_file::write_now(void const*, size_t, uint64_t)", "WriteFile(HANDLE, LPCVOID, DWORD, LPDWORD, LPOVERLAPPED)" };
+#endif
+#ifdef OS_LINUX
+                throw i_op::error_msg{ err, "i_op::async_file::write_now(void const*, size_t, uint64_t)", "pwrite(int, void const*, size_t, off_t)" };
+#endif
+            }
+        }
+
+
+        /**
+         * @brief Waits until write of slot `_slot` is done. Does nothing if slot is idle
+         * @throw i_op::error_msg – contains OS-specific error code of failed write
+         */
+        inline void wait(unsigned _slot) noexcept(false)
+        {
+            request& req = *this->__slots[_slot];
+#ifdef OS_LINUX
+            while (req.busy && this->__ring >= 0) { this->ring_reap(); }
+#endif
+            if (req.busy)
+            {
+                req.done.acquire();
+                req.busy = false;
+            }
+            if (req.err != 0)
+            {
+                long err = req.err;
+                req.err = 0;
+#ifdef OS_WIN32
+                throw i_op::error_msg{ (DWORD)err, "i_op::async_file::wait(unsigned)", "WriteFile(HANDLE, LPCVOID, DWORD, LPDWORD, LPOVERLAPPED)" };
+#endif
+#ifdef OS_LINUX
+                throw i_op::error_msg{ err, "i_op::async_file::wait(unsigned)", "pwrite(int, void const*, size_t, off_t)" };
+#endif
+            }
+        }
+
+        /**
+         * @brief Waits until all writes are done
+         * @throw i_op::error_msg – contains OS-specific error code of first failed write
+         */
+        inline void wait_all() noexcept(false)
+        {
+            long err = 0;
+            for (unsigned i = 0; i < this->slots(); i++)
+            {
+                try { this->wait(i); }
+                catch (i_op::error_msg const& e) { if (err == 0) { err = e.__err_code; } }
+            }
+            if (err != 0)
+            {
+#ifdef OS_WIN32
+                throw i_op::error_msg{ (DWORD)err, "i_op::async_file::wait_all()", "WriteFile(HANDLE, LPCVOID, DWORD, LPDWORD, LPOVERLAPPED)" };
+#endif
+#ifdef OS_LINUX
+                throw i_op::error_msg{ err, "i_op::async_file::wait_all()", "pwrite(int, void const*, size_t, off_t)" };
+#endif
+            }
+        }
+
+
+        /**
+         * @brief Waits for pending writes, stops threads and closes file, throwing on failure. Consecutive calls
+         *      do nothing
+         * @throw i_op::error_msg – contains OS-specific error code
+         */
+        inline void close() noexcept(false)
+        {
+#ifdef OS_WIN32
+            if (this->__fl_hdl == INVALID_HANDLE_VALUE) { return; }
+#endif
+#ifdef OS_LINUX
+            if (this->__fl_dtr < 0) { return; }
+#endif
+            long err = 0;
+            try { this->wait_all(); }
+            catch (i_op::error_msg const& e) { err = e.__err_code; }
+
+            for (auto& req : this->__slots)
+            {
+                if (!req->started) { continue; }
+                req->stop = true;
+                req->go.release();
+                req->worker.join();
+                req->started = false;
+            }
+
+#ifdef OS_WIN32
+            DWORD e{ 0 };
+            if (!!CloseHandle(this->__fl_hdl) == false) { e = GetLastError(); }
+            this->__fl_hdl = INVALID_HANDLE_VALUE;
+#endif
+#ifdef OS_LINUX
+            if (this->__ring >= 0)
+            {
+                munmap(this->__sqes, this->__sqes_len);
+                if (this->__cq_map != this->__sq_map) { munmap(this->__cq_map, this->__cq_map_len); }
+                munmap(this->__sq_map, this->__sq_map_len);
+                ::close(this->__ring);
+                this->__ring = -1;
+            }
+            int e{ 0 };
+            if (::close(this->__fl_dtr) != 0) { e = errno; }
+            this->__fl_dtr = -1;
+#endif
+
+            const char* m = "i_op::async_file::close()";
+            if (err != 0)
+            {
+#ifdef OS_WIN32
+                throw i_op::error_msg{ (DWORD)err, m, "WriteFile(HANDLE, LPCVOID, DWORD, LPDWORD, LPOVERLAPPED)" };
+#endif
+#ifdef OS_LINUX
+                throw i_op::error_msg{ err, m, "pwrite(int, void const*, size_t, off_t)" };
+#endif
+            }
+            if (e != 0)
+            {
+#ifdef OS_WIN32
+                throw i_op::error_msg{ e, m, "CloseHandle(HANDLE)" };
+#endif
+#ifdef OS_LINUX
+                throw i_op::error_msg{ e, m, "close(int)" };
+#endif
+            }
+        }
+    };
+}
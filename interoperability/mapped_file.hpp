@@ -0,0 +1,178 @@
+/* ========================================================================== */
+/* Author: Marcin Jeznach || plz no steal 😭                                  */
+/*                                                                            */
+/* File mapped into memory, with OS-independent interface. Contents are       */
+/* paged in and out by OS, so mapping may be much larger than physical memory */
+/* ========================================================================== */
+#pragma once
+#include "./macro.hpp"
+
+#ifdef OS_WIN32
+#include <windows.h>
+#endif
+#ifdef OS_LINUX
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <cstdlib>
+
+#include "./error_msg.hpp"
+
+namespace i_op
+{
+    /**
+     * @brief File on disk, mapped for reading and writing. Objects are neither copyable, nor movable
+     *
+     * @tparam T type of objects (or primitives) held in file
+     */
+    template<typename T>
+    class mapped_file final
+    {
+    private:
+        T* __ptr{ nullptr };
+        size_t __len{ 0 };
+#ifdef OS_WIN32
+        HANDLE __fl_hdl{ INVALID_HANDLE_VALUE };
+        HANDLE __map_hdl{ nullptr };
+#endif
+#ifdef OS_LINUX
+        int __fl_dtr{ -1 };
+#endif
+
+
+    public:
+        mapped_file(mapped_file const&) = delete;
+        mapped_file& operator =(mapped_file const&) = delete;
+
+        /**
+         * @brief Creates (or opens) file, resizes it to `_n_elem` elements and maps it. New parts of file are
+         *      filled with zeros
+         *
+         * @param _path file system path of file
+         * @param _n_elem number of elements (of type `T`) that file should hold - must be positive
+         * @throw i_op::error_msg – contains OS-specific error code
+         */
+        inline mapped_file(char const* _path, size_t _n_elem) noexcept(false)
+        {
+#ifdef OS_WIN32
+            this->__fl_hdl = CreateFileA(_path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (this->__fl_hdl == INVALID_HANDLE_VALUE)
+            {
+                throw i_op::error_msg{ GetLastError(), "i_op::mapped_file<T>::mapped_file(char const*, size_t)", "CreateFileA(LPCSTR, DWORD, DWORD, LPSECURITY_ATTRIBUTES, DWORD, DWORD, HANDLE)" };
+            }
+
+            unsigned long long size = (unsigned long long)_n_elem * sizeof(T);
+            this->__map_hdl = CreateFileMappingA(this->__fl_hdl, nullptr, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, nullptr);
+            if (this->__map_hdl == nullptr)
+            {
+                DWORD err{ GetLastError() };
+                CloseHandle(this->__fl_hdl);
+                throw i_op::error_msg{ err, "i_op::mapped_file<T>::mapped_file(char const*, size_t)", "CreateFileMappingA(HANDLE, LPSECURITY_ATTRIBUTES, DWORD, DWORD, DWORD, LPCSTR)" };
+            }
+
+            this->__ptr = (T*)MapViewOfFile(this->__map_hdl, FILE_MAP_ALL_ACCESS, 0, 0, size);
+            if (this->__ptr == nullptr)
+            {
+                DWORD err{ GetLastError() };
+                CloseHandle(this->__map_hdl);
+                CloseHandle(this->__fl_hdl);
+                throw i_op::error_msg{ err, "i_op::mapped_file<T>::mapped_file(char const*, size_t)", "MapViewOfFile(HANDLE, DWORD, DWORD, DWORD, SIZE_T)" };
+            }
+#endif
+#ifdef OS_LINUX
+            this->__fl_dtr = open(_path, O_CREAT | O_RDWR, 0664);
+            if (this->__fl_dtr < 0)
+            {
+                throw i_op::error_msg{ errno, "i_op::mapped_file<T>::mapped_file(char const*, size_t)", "open(char const*, int, mode_t)" };
+            }
+
+            if (ftruncate(this->__fl_dtr, _n_elem * sizeof(T)) != 0)
+            {
+                int err = errno;
+                ::close(this->__fl_dtr);
+                throw i_op::error_msg{ err, "i_op::mapped_file<T>::mapped_file(char const*, size_t)", "ftruncate(int, off_t)" };
+            }
+
+            this->__ptr = (T*)mmap(nullptr, _n_elem * sizeof(T), PROT_READ | PROT_WRITE, MAP_SHARED, this->__fl_dtr, 0);
+            if (this->__ptr == MAP_FAILED)
+            {
+                int err = errno;
+                this->__ptr = nullptr;
+                ::close(this->__fl_dtr);
+                throw i_op::error_msg{ err, "i_op::mapped_file<T>::mapped_file(char const*, size_t)", "mmap(void*, size_t, int, int, int, off_t)" };
+            }
+#endif
+            this->__len = _n_elem;
+        }
+
+
+        /**
+         * @brief Performs destruction of object, ignoring exceptions on failure
+         */
+        inline ~mapped_file()
+        {
+            try { this->close(); }
+            catch (i_op::error_msg const&) {}
+        }
+
+
+        /**
+         * @return pointer to the beginning of mapping of file
+         */
+        T* ptr() { return this->__ptr; }
+        /**
+         * @return length of the mapping of file (treated as array of `T`)
+         */
+        size_t len() { return this->__len; }
+
+
+        /**
+         * @brief Unmaps and closes file, throwing on failure. Consecutive calls do nothing
+         * @throw i_op::error_msg – contains OS-specific error code
+         */
+        inline void close() noexcept(false)
+        {
+            if (this->__ptr == nullptr) { return; }
+#ifdef OS_WIN32
+            DWORD e[3]{ 0 };
+            if (!!UnmapViewOfFile(this->__ptr) == false) { e[0] = GetLastError(); }
+            if (!!CloseHandle(this->__map_hdl) == false) { e[1] = GetLastError(); }
+            if (!!CloseHandle(this->__fl_hdl) == false) { e[2] = GetLastError(); }
+            this->__map_hdl = nullptr;
+            this->__fl_hdl = INVALID_HANDLE_VALUE;
+#endif
+#ifdef OS_LINUX
+            int e[2]{ 0 };
+            if (munmap(this->__ptr, this->__len * sizeof(T)) != 0) { e[0] = errno; }
+            if (::close(this->__fl_dtr) != 0) { e[1] = errno; }
+            this->__fl_dtr = -1;
+#endif
+            this->__ptr = nullptr;
+            this->__len = 0;
+
+            const char* m = "i_op::mapped_file<T>::close()";
+#ifdef OS_WIN32
+            if (e[0] != 0)
+            {
+                throw i_op::error_msg{ e[0], m, "UnmapViewOfFile(LPCVOID)" };
+            }
+            if (e[1] != 0 || e[2] != 0)
+            {
+                throw i_op::error_msg{ e[1] != 0 ? e[1] : e[2], m, "CloseHandle(HANDLE)" };
+            }
+#endif
+#ifdef OS_LINUX
+            if (e[0] != 0)
+            {
+                throw i_op::error_msg{ e[0], m, "munmap(void*, size_t)" };
+            }
+            if (e[1] != 0)
+            {
+                throw i_op::error_msg{ e[1], m, "close(int)" };
+            }
+#endif
+        }
+    };
+}
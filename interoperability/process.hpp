@@ -6,15 +6,157 @@
 #endif
 #ifdef OS_LINUX
 #include <unistd.h>
+#include <climits>
+#include <fstream>
+#include <set>
+#include <utility>
+#include <sched.h>
 #endif
 
+#include <string>
+#include <stdexcept>
+#include <vector>
+#include <cstddef>
+
 namespace i_op
 {
+    /**
+     * @brief Description of processors and caches of host. Values that cannot be read are left as `0`
+     */
+    struct cpu_topology
+    {
+        /// @brief Number of logical (online) processors
+        unsigned int logical;
+        /// @brief Number of physical cores
+        unsigned int cores;
+        /// @brief Number of logical processors (SMT siblings) per physical core
+        unsigned int smt;
+        /// @brief Size of L1 data cache (per core) in bytes
+        size_t l1d;
+        /// @brief Size of L2 cache in bytes
+        size_t l2;
+        /// @brief Size of L3 cache in bytes
+        size_t l3;
+        /// @brief Size of cache line in bytes
+        size_t line;
+        /// @brief Number of NUMA nodes
+        unsigned int numa_nodes;
+    };
+
     /**
      * @brief Process-related utilities
      */
     class process
     {
+#ifdef OS_LINUX
+    private:
+        /**
+         * @return First line of file, or empty string if it cannot be read
+         */
+        inline static std::string read_line(std::string const& _path)
+        {
+            std::ifstream in(_path);
+            std::string line;
+            std::getline(in, line);
+            return line;
+        }
+
+        /**
+         * @return Size in bytes parsed from sysfs format (like `48K` or `32M`), or 0 if empty
+         */
+        inline static size_t parse_size(std::string const& _str)
+        {
+            if (_str.empty()) { return 0; }
+            size_t pos = 0;
+            size_t val = std::stoull(_str, &pos);
+            if (pos < _str.size())
+            {
+                switch (_str[pos])
+                {
+                case 'K': val <<= 10; break;
+                case 'M': val <<= 20; break;
+                case 'G': val <<= 30; break;
+                }
+            }
+            return val;
+        }
+
+        /**
+         * @brief Reads CPU bandwidth limit of cgroup directory `_dir` and all of its ancestors (up to `_root`)
+         *
+         * @param _v2 whether `_dir` is cgroup v2 directory (`cpu.max`) or v1 one (`cpu.cfs_quota_us`)
+         * @return Strictest limit as fraction of CPUs, or negative value if none is set
+         */
+        inline static double cgroup_quota(std::string const& _root, std::string _dir, bool _v2)
+        {
+            double quota = -1;
+            while (true)
+            {
+                std::string path = _root + _dir;
+                double q = -1;
+                /* =========================================================================== */
+                /* Contents that cannot be parsed are treated as no quota, like no file at all */
+                /* =========================================================================== */
+                try
+                {
+                    if (_v2)
+                    {
+                        auto max = read_line(path + "/cpu.max");
+                        auto sp = max.find(' ');
+                        if (!max.empty() && max.compare(0, 3, "max") != 0 && sp != std::string::npos)
+                        {
+                            q = std::stod(max.substr(0, sp)) / std::stod(max.substr(sp + 1));
+                        }
+                    }
+                    else
+                    {
+                        auto us = read_line(path + "/cpu.cfs_quota_us");
+                        auto period = read_line(path + "/cpu.cfs_period_us");
+                        if (!us.empty() && !period.empty() && std::stoll(us) > 0)
+                        {
+                            q = std::stod(us) / std::stod(period);
+                        }
+                    }
+                }
+                catch (std::logic_error const&)
+                {
+                    q = -1;
+                }
+                if (q > 0 && (quota < 0 || q < quota)) { quota = q; }
+
+                if (_dir.empty() || _dir == "/") { break; }
+                _dir = _dir.substr(0, _dir.rfind('/'));
+            }
+            return quota;
+        }
+
+    public:
+        /**
+         * @brief Parses list of CPUs in kernel format (like `0-3,8,10-11`)
+         *
+         * @return Sorted numbers of CPUs in list
+         */
+        inline static std::vector<unsigned int> parse_cpu_list(std::string const& _list)
+        {
+            std::vector<unsigned int> cpus;
+            size_t pos = 0;
+            while (pos < _list.size())
+            {
+                size_t end = _list.find(',', pos);
+                if (end == std::string::npos) { end = _list.size(); }
+                auto part = _list.substr(pos, end - pos);
+                auto dash = part.find('-');
+                if (!part.empty() && part[0] >= '0' && part[0] <= '9')
+                {
+                    unsigned int lo = (unsigned int)std::stoul(part);
+                    unsigned int hi = dash == std::string::npos ? lo : (unsigned int)std::stoul(part.substr(dash + 1));
+                    for (unsigned int c = lo; c <= hi; c++) { cpus.push_back(c); }
+                }
+                pos = end + 1;
+            }
+            return cpus;
+        }
+#endif
 
     public:
         /**
@@ -44,5 +186,183 @@ namespace i_op
             return (unsigned int)sysconf(_SC_NPROCESSORS_ONLN);
 #endif
         }
+
+
+        /**
+         * @brief Number of CPUs that current process can actually use - which is the smaller of CPUs in its
+         * affinity mask and CPU bandwidth quota of its cgroup (v1 `cpu.cfs_quota_us` or v2 `cpu.max`,
+         * rounded up). This is the value that should be used as default thread count, as spawning more
+         * threads would only get them throttled.
+         *
+         * @return Number of usable CPUs, at least 1
+         */
+        inline static unsigned int get_available_CPU_count()
+        {
+            unsigned int count = get_CPU_count();
+#ifdef OS_WIN32
+            DWORD_PTR proc_mask, sys_mask;
+            if (GetProcessAffinityMask(GetCurrentProcess(), &proc_mask, &sys_mask))
+            {
+                unsigned int bits = 0;
+                for (; proc_mask != 0; proc_mask &= proc_mask - 1) { bits++; }
+                if (bits > 0 && bits < count) { count = bits; }
+            }
+#endif
+#ifdef OS_LINUX
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            if (sched_getaffinity(0, sizeof(set), &set) == 0)
+            {
+                unsigned int bits = (unsigned int)CPU_COUNT(&set);
+                if (bits > 0 && bits < count) { count = bits; }
+            }
+
+            /* ==================================================================================== */
+            /* Each line of /proc/self/cgroup is `id:controllers:path` - v2 has id 0 and no         */
+            /* controllers, v1 is mounted per controller list, and either may be mounted at root    */
+            /* ==================================================================================== */
+            double quota = -1;
+            std::ifstream cg("/proc/self/cgroup");
+            std::string line;
+            while (std::getline(cg, line))
+            {
+                auto c1 = line.find(':');
+                auto c2 = line.find(':', c1 + 1);
+                if (c1 == std::string::npos || c2 == std::string::npos) { continue; }
+                auto ctrl = line.substr(c1 + 1, c2 - c1 - 1);
+                auto path = line.substr(c2 + 1);
+
+                std::vector<std::pair<std::string, bool>> roots;
+                if (ctrl.empty())
+                {
+                    roots.push_back({ "/sys/fs/cgroup", true });
+                    roots.push_back({ "/sys/fs/cgroup/unified", true });
+                }
+                else if (("," + ctrl + ",").find(",cpu,") != std::string::npos)
+                {
+                    roots.push_back({ "/sys/fs/cgroup/" + ctrl, false });
+                    roots.push_back({ "/sys/fs/cgroup/cpu", false });
+                }
+
+                for (auto const& root : roots)
+                {
+                    double q = cgroup_quota(root.first, path, root.second);
+                    if (q > 0 && (quota < 0 || q < quota)) { quota = q; }
+                }
+            }
+            if (quota > 0)
+            {
+                unsigned int limit = (unsigned int)quota;
+                if (limit < quota) { limit++; }
+                if (limit < count) { count = limit; }
+            }
+#endif
+            return count > 0 ? count : 1;
+        }
+
+
+        /**
+         * @brief Queries topology of processors and caches of host.
+         *
+         * On Linux values are read from `/sys/devices/system/cpu` and `/sys/devices/system/node`, cache
+         * sizes are taken from first online CPU.
+         *
+         * @return Topology of host - values that cannot be determined are `0`, except for `logical`, which falls
+         *      back to `get_CPU_count()`, `cores` to `logical`, and `smt` and `numa_nodes` to `1`
+         */
+        inline static cpu_topology get_CPU_topology()
+        {
+            cpu_topology topo{};
+            topo.logical = get_CPU_count();
+#ifdef OS_WIN32
+            DWORD len = 0;
+            GetLogicalProcessorInformation(nullptr, &len);
+            std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(len / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+            if (!info.empty() && GetLogicalProcessorInformation(info.data(), &len))
+            {
+                for (auto const& i : info)
+                {
+                    switch (i.Relationship)
+                    {
+                    case RelationProcessorCore:
+                        topo.cores++;
+                        break;
+                    case RelationNumaNode:
+                        topo.numa_nodes++;
+                        break;
+                    case RelationCache:
+                        if (i.Cache.Level == 1 && i.Cache.Type == CacheData) { topo.l1d = i.Cache.Size; }
+                        else if (i.Cache.Level == 2) { topo.l2 = i.Cache.Size; }
+                        else if (i.Cache.Level == 3) { topo.l3 = i.Cache.Size; }
+                        topo.line = i.Cache.LineSize;
+                        break;
+                    default:
+                        break;
+                    }
+                }
+            }
+#endif
+#ifdef OS_LINUX
+            std::string const sys = "/sys/devices/system/cpu/";
+            auto online = parse_cpu_list(read_line(sys + "online"));
+            if (!online.empty()) { topo.logical = (unsigned int)online.size(); }
+
+            /* ======================================================================== */
+            /* Physical cores are unique pairs of package and core id among online CPUs */
+            /* ======================================================================== */
+            std::set<std::pair<std::string, std::string>> cores;
+            for (auto c : online)
+            {
+                auto dir = sys + "cpu" + std::to_string(c) + "/topology/";
+                auto core = read_line(dir + "core_id");
+                if (core.empty()) { continue; }
+                cores.insert({ read_line(dir + "physical_package_id"), core });
+            }
+            topo.cores = (unsigned int)cores.size();
+
+            /* ===================================================== */
+            /* Cache levels are listed as `index0`..`indexN` per CPU */
+            /* ===================================================== */
+            auto first = online.empty() ? 0u : online[0];
+            for (int i = 0; ; i++)
+            {
+                auto dir = sys + "cpu" + std::to_string(first) + "/cache/index" + std::to_string(i) + "/";
+                auto level = read_line(dir + "level");
+                if (level.empty()) { break; }
+                auto type = read_line(dir + "type");
+                auto size = parse_size(read_line(dir + "size"));
+
+                if (level == "1" && type == "Data") { topo.l1d = size; }
+                else if (level == "2") { topo.l2 = size; }
+                else if (level == "3") { topo.l3 = size; }
+                if (topo.line == 0) { topo.line = parse_size(read_line(dir + "coherency_line_size")); }
+            }
+
+            topo.numa_nodes = (unsigned int)parse_cpu_list(read_line("/sys/devices/system/node/online")).size();
+#endif
+            if (topo.cores == 0) { topo.cores = topo.logical; }
+            if (topo.numa_nodes == 0) { topo.numa_nodes = 1; }
+            topo.smt = topo.logical / topo.cores > 0 ? topo.logical / topo.cores : 1;
+            return topo;
+        }
+
+
+        /**
+         * @return Network name of host that runs current process, or empty string if it cannot be read
+         */
+        inline static std::string get_host_name()
+        {
+#ifdef OS_WIN32
+            char name[MAX_COMPUTERNAME_LENGTH + 1]{};
+            DWORD len = sizeof(name);
+            if (!GetComputerNameA(name, &len)) { return ""; }
+            return std::string{ name, (size_t)len };
+#endif
+#ifdef OS_LINUX
+            char name[HOST_NAME_MAX + 1]{};
+            if (gethostname(name, sizeof(name) - 1) != 0) { return ""; }
+            return std::string{ name };
+#endif
+        }
     };
 }
@@ -0,0 +1,373 @@
+/* ========================================================================== */
+/* Author: Marcin Jeznach || plz no steal 😭                                  */
+/*                                                                            */
+/* Local (Unix domain) stream socket with OS-independent interface. Sockets   */
+/* are identified by file system path, and carry reliable byte stream - so    */
+/* protocols built on them can later be moved to TCP unchanged. Win32 is not  */
+/* supported yet, every operation throws `std::system_error` there.           */
+/* ========================================================================== */
+#pragma once
+#include "./macro.hpp"
+
+#ifdef OS_WIN32
+#include <windows.h>
+#endif
+#ifdef OS_LINUX
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <system_error>
+
+#include "./error_msg.hpp"
+
+namespace i_op
+{
+    /**
+     * @brief Stream socket bound to, or connected to file system path. Objects are movable, but not copyable -
+     *      each one owns its native socket
+     */
+    class local_socket final
+    {
+    private:
+#ifdef OS_LINUX
+        int __fd{ -1 };
+#endif
+        /// @brief Path that was bound by listening socket - unlinked on close
+        std::string __path;
+
+        inline local_socket() {}
+
+
+    public:
+        local_socket(local_socket const&) = delete;
+        local_socket& operator =(local_socket const&) = delete;
+
+        inline local_socket(local_socket&& _other) noexcept
+        {
+#ifdef OS_LINUX
+            this->__fd = _other.__fd;
+            _other.__fd = -1;
+#endif
+            this->__path = std::move(_other.__path);
+            _other.__path.clear();
+        }
+
+        inline local_socket& operator =(local_socket&& _other) noexcept
+        {
+            if (this != &_other)
+            {
+                try { this->close(); }
+                catch (i_op::error_msg const&) {}
+#ifdef OS_LINUX
+                this->__fd = _other.__fd;
+                _other.__fd = -1;
+#endif
+                this->__path = std::move(_other.__path);
+                _other.__path.clear();
+            }
+            return *this;
+        }
+
+
+        /**
+         * @brief Creates socket listening on `_path`. Stale socket file left by previous process is removed
+         *
+         * @param _path file system path of socket
+         * @param _backlog number of pending connections kept by OS
+         * @throw i_op::error_msg – contains OS-specific error code
+         * @throw std::system_error – if local sockets are not supported by this OS
+         */
+        inline static local_socket listen(char const* _path, int _backlog = 16) noexcept(false)
+        {
+            local_socket s;
+#ifdef OS_WIN32
+            (void)_path;
+            (void)_backlog;
+            throw std::system_error(std::make_error_code((std::errc)ENOSYS), "i_op::local_socket is not supported on this platform");
+#endif
+#ifdef OS_LINUX
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            if (std::strlen(_path) >= sizeof(addr.sun_path))
+            {
+                throw i_op::error_msg{ ENAMETOOLONG, "i_op::local_socket::listen(char const*, int)", "bind(int, sockaddr const*, socklen_t)" };
+            }
+            std::strcpy(addr.sun_path, _path);
+
+            s.__fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (s.__fd < 0)
+            {
+                throw i_op::error_msg{ errno, "i_op::local_socket::listen(char const*, int)", "socket(int, int, int)" };
+            }
+            ::unlink(_path);
+            if (bind(s.__fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+            {
+                throw i_op::error_msg{ errno, "i_op::local_socket::listen(char const*, int)", "bind(int, sockaddr const*, socklen_t)" };
+            }
+            s.__path = _path;
+            if (::listen(s.__fd, _backlog) != 0)
+            {
+                throw i_op::error_msg{ errno, "i_op::local_socket::listen(char const*, int)", "listen(int, int)" };
+            }
+#endif
+            return s;
+        }
+
+
+        /**
+         * @brief Connects to socket listening on `_path`
+         *
+         * @throw i_op::error_msg – contains OS-specific error code
+         * @throw std::system_error – if local sockets are not supported by this OS
+         */
+        inline static local_socket connect(char const* _path) noexcept(false)
+        {
+            local_socket s;
+#ifdef OS_WIN32
+            (void)_path;
+            throw std::system_error(std::make_error_code((std::errc)ENOSYS), "i_op::local_socket is not supported on this platform");
+#endif
+#ifdef OS_LINUX
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            if (std::strlen(_path) >= sizeof(addr.sun_path))
+            {
+                throw i_op::error_msg{ ENAMETOOLONG, "i_op::local_socket::connect(char const*)", "connect(int, sockaddr const*, socklen_t)" };
+            }
+            std::strcpy(addr.sun_path, _path);
+
+            s.__fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (s.__fd < 0)
+            {
+                throw i_op::error_msg{ errno, "i_op::local_socket::connect(char const*)", "socket(int, int, int)" };
+            }
+            if (::connect(s.__fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+            {
+                throw i_op::error_msg{ errno, "i_op::local_socket::connect(char const*)", "connect(int, sockaddr const*, socklen_t)" };
+            }
+#endif
+            return s;
+        }
+
+
+        /**
+         * @brief Waits for and accepts next connection of listening socket
+         *
+         * @throw i_op::error_msg – contains OS-specific error code
+         */
+        inline local_socket accept() noexcept(false)
+        {
+            local_socket s;
+#ifdef OS_LINUX
+            s.__fd = ::accept(this->__fd, nullptr, nullptr);
+            if (s.__fd < 0)
+            {
+                throw i_op::error_msg{ errno, "i_op::local_socket::accept()", "accept(int, sockaddr*, socklen_t*)" };
+            }
+#endif
+            return s;
+        }
+
+
+        /**
+         * @brief Sends all `_len` bytes of `_buf`, waiting if necessary. Writing to socket closed by
+         *      peer throws instead of raising signal
+         *
+         * @throw i_op::error_msg – contains OS-specific error code
+         */
+        inline void send(void const* _buf, size_t _len) noexcept(false)
+        {
+#ifdef OS_LINUX
+            char const* p = (char const*)_buf;
+            while (_len > 0)
+            {
+                ssize_t sent = ::send(this->__fd, p, _len, MSG_NOSIGNAL);
+                if (sent < 0)
+                {
+                    if (errno == EINTR) { continue; }
+                    throw i_op::error_msg{ errno, "i_op::local_socket::send(void const*, size_t)", "send(int, void const*, size_t, int)" };
+                }
+                p += sent;
+                _len -= (size_t)sent;
+            }
+#endif
+        }
+
+
+        /**
+         * @brief Sends as much of `_len` bytes of `_buf`, as socket accepts right away - never waits. Writing to
+         *      socket closed by peer throws instead of raising signal
+         *
+         * @return Count of bytes sent, `0` if socket cannot accept any now
+         * @throw i_op::error_msg – contains OS-specific error code
+         */
+        inline size_t send_some(void const* _buf, size_t _len) noexcept(false)
+        {
+#ifdef OS_LINUX
+            while (_len > 0)
+            {
+                ssize_t sent = ::send(this->__fd, _buf, _len, MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (sent >= 0) { return (size_t)sent; }
+                if (errno == EINTR) { continue; }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) { return 0; }
+                throw i_op::error_msg{ errno, "i_op::local_socket::send_some(void const*, size_t)", "send(int, void const*, size_t, int)" };
+            }
+#endif
+            return 0;
+        }
+
+
+        /**
+         * @brief Receives exactly `_len` bytes into `_buf`, waiting if necessary
+         *
+         * @return `false` if peer closed connection before all bytes arrived
+         * @throw i_op::error_msg – contains OS-specific error code
+         */
+        inline bool receive(void* _buf, size_t _len) noexcept(false)
+        {
+#ifdef OS_LINUX
+            char* p = (char*)_buf;
+            while (_len > 0)
+            {
+                ssize_t got = ::recv(this->__fd, p, _len, 0);
+                if (got == 0) { return false; }
+                if (got < 0)
+                {
+                    if (errno == EINTR) { continue; }
+                    if (errno == ECONNRESET) { return false; }
+                    throw i_op::error_msg{ errno, "i_op::local_socket::receive(void*, size_t)", "recv(int, void*, size_t, int)" };
+                }
+                p += got;
+                _len -= (size_t)got;
+            }
+#endif
+            return true;
+        }
+
+
+        /**
+         * @brief Receives whatever is available (at least 1 byte, at most `_max`) into `_buf`, waiting if nothing is
+         *
+         * @return Count of bytes received, `0` if peer closed connection
+         * @throw i_op::error_msg – contains OS-specific error code
+         */
+        inline size_t receive_some(void* _buf, size_t _max) noexcept(false)
+        {
+#ifdef OS_LINUX
+            while (true)
+            {
+                ssize_t got = ::recv(this->__fd, _buf, _max, 0);
+                if (got >= 0) { return (size_t)got; }
+                if (errno == EINTR) { continue; }
+                if (errno == ECONNRESET) { return 0; }
+                throw i_op::error_msg{ errno, "i_op::local_socket::receive_some(void*, size_t)", "recv(int, void*, size_t, int)" };
+            }
+#endif
+            return 0;
+        }
+
+
+        /**
+         * @brief Waits until at least one of `_socks` has data to read, pending connection, or was closed by peer
+         *
+         * @param _timeout_ms maximal waiting time in milliseconds, or -1 to wait indefinitely
+         * @return Indices of ready sockets in `_socks` (empty on timeout)
+         * @throw i_op::error_msg – contains OS-specific error code
+         */
+        inline static std::vector<size_t> wait_readable(std::vector<local_socket const*> const& _socks, int _timeout_ms = -1) noexcept(false)
+        {
+            std::vector<size_t> ready;
+            auto state = wait(_socks, std::vector<unsigned>(_socks.size(), Readable), _timeout_ms);
+            for (size_t i = 0; i < state.size(); i++)
+            {
+                if (state[i] != 0) { ready.push_back(i); }
+            }
+            return ready;
+        }
+
+        /// @brief Conditions, that `wait` waits for
+        enum condition : unsigned
+        {
+            Readable = 1, Writable = 2
+        };
+
+        /**
+         * @brief Waits until at least one of `_socks` meets one of its conditions - socket closed by peer (or
+         *      failed) counts as readable, so that following receive reports it
+         *
+         * @param _conditions `condition` flags of every socket in `_socks` - sockets with none are skipped
+         * @param _timeout_ms maximal waiting time in milliseconds, or -1 to wait indefinitely
+         * @return Conditions met by every socket in `_socks` (all `0` on timeout)
+         * @throw i_op::error_msg – contains OS-specific error code
+         */
+        inline static std::vector<unsigned> wait(std::vector<local_socket const*> const& _socks, std::vector<unsigned> const& _conditions, int _timeout_ms = -1) noexcept(false)
+        {
+            std::vector<unsigned> state(_socks.size(), 0);
+#ifdef OS_LINUX
+            std::vector<pollfd> fds(_socks.size());
+            for (size_t i = 0; i < _socks.size(); i++)
+            {
+                short events = (short)(((_conditions[i] & Readable) ? POLLIN : 0) | ((_conditions[i] & Writable) ? POLLOUT : 0));
+                fds[i] = pollfd{ events != 0 ? _socks[i]->__fd : -1, events, 0 };
+            }
+
+            int result;
+            do { result = poll(fds.data(), fds.size(), _timeout_ms); } while (result < 0 && errno == EINTR);
+            if (result < 0)
+            {
+                throw i_op::error_msg{ errno, "i_op::local_socket::wait(std::vector<local_socket const*> const&, std::vector<unsigned> const&, int)", "poll(pollfd*, nfds_t, int)" };
+            }
+
+            for (size_t i = 0; i < fds.size(); i++)
+            {
+                if (fds[i].revents & (POLLIN | POLLHUP | POLLERR | POLLNVAL)) { state[i] |= Readable; }
+                if (fds[i].revents & POLLOUT) { state[i] |= Writable; }
+            }
+#endif
+            return state;
+        }
+
+
+        /**
+         * @brief Performs destruction of object, ignoring exceptions on failure
+         */
+        inline ~local_socket()
+        {
+            try { this->close(); }
+            catch (i_op::error_msg const&) {}
+        }
+
+
+        /**
+         * @brief Closes socket (and removes its file, if it was listening), throwing on failure.
+         *      Consecutive calls do nothing
+         * @throw i_op::error_msg – contains OS-specific error code
+         */
+        inline void close() noexcept(false)
+        {
+#ifdef OS_LINUX
+            if (!this->__path.empty())
+            {
+                ::unlink(this->__path.c_str());
+                this->__path.clear();
+            }
+            if (this->__fd >= 0)
+            {
+                int fd = this->__fd;
+                this->__fd = -1;
+                if (::close(fd) != 0)
+                {
+                    throw i_op::error_msg{ errno, "i_op::local_socket::close()", "close(int)" };
+                }
+            }
+#endif
+        }
+    };
+}
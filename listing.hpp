@@ -0,0 +1,145 @@
+#pragma once
+
+#include <charconv>
+#include <ostream>
+#include <vector>
+#include <cstdint>
+#include <new>
+
+#include "interoperability/thread.hpp"
+#include "util/memory.hpp"
+#include "sieving_strategies.hpp"
+
+namespace listing
+{
+    typedef long long llong;
+
+    /**
+     * @brief Part of bit sieve segment, formatted by single thread
+     */
+    struct slice
+    {
+        /// @brief Words of bit sieve segment
+        uint64_t const* words;
+        /// @brief Number held by first bit of `words`
+        llong base;
+        /// @brief First index of slice in segment (multiple of 64)
+        llong from;
+        /// @brief Last index of slice in segment (inclusive)
+        llong to;
+        /// @brief Buffer for text of slice - large enough for every prime in it
+        char* text;
+        /// @brief End of `text` buffer
+        char* end;
+        /// @brief Count of characters written to `text` (output)
+        size_t len;
+    };
+
+    /**
+     * @brief Runnable thread function, that writes primes of slice in decimal, one per line
+     *
+     * @param _slice `listing::slice*` casted to `void*`
+     * @return `i_op::thread::OS_Runnable_OK`
+     */
+    auto thread_format(void* _slice)
+    {
+        auto slice = (struct slice*)_slice;
+        char* p = slice->text;
+
+        for (llong w = slice->from / 64; w * 64 <= slice->to; w++)
+        {
+            uint64_t primes = ~slice->words[w];
+            if (slice->to - w * 64 < 63) { primes &= ((uint64_t)1 << (slice->to - w * 64 + 1)) - 1; }
+            while (primes != 0)
+            {
+                /* ===================================================================== */
+                /* Buffer was sized for widest number in segment, so `to_chars` never    */
+                /* reaches `end` - it is passed only to keep the range inside the buffer */
+                /* ===================================================================== */
+                p = std::to_chars(p, slice->end, (uint64_t)(slice->base + w * 64 + __builtin_ctzll(primes))).ptr;
+                *p++ = '\n';
+                primes &= primes - 1;
+            }
+        }
+
+        slice->len = p - slice->text;
+        return i_op::thread::OS_Runnable_OK;
+    }
+
+    /**
+     * @brief Streaming writer of prime list as decimal text - fed with consecutive segments of bit sieve,
+     *      that are formatted by multiple threads into their own buffers, then written in order by caller
+     */
+    class writer
+    {
+    private:
+        std::ostream& __out;
+        int __th;
+        /// @brief Text buffers of threads - taken anew for every segment, and given back right after, so
+        ///     memory of the largest segment is kept and reused
+        util::arena __arena;
+        uint64_t __count = 0;
+
+        writer(writer const&) = delete;
+
+
+    public:
+        /**
+         * @param _out stream that receives list
+         * @param _th max threads used for formatting (-1 for all available)
+         */
+        writer(std::ostream& _out, int _th = -1): __out(_out), __th(_th) {}
+
+        /// @return `true` if no write failed so far
+        bool good() const { return (bool)this->__out; }
+
+        /// @return Count of primes written so far
+        uint64_t count() const { return this->__count; }
+
+        /**
+         * @brief Writes primes of bit sieve segment, that holds numbers `_base`..`_base + _len - 1`
+         *      (bit set for composites, as in `sieving_strategy::storage::bit`)
+         *
+         * @throw std::bad_alloc – if memory for text buffers cannot be allocated
+         */
+        void feed(uint64_t const* _words, llong _base, llong _len)
+        {
+            if (_len <= 0) { return; }
+
+            auto parts = sieving_strategy::partition(0, _len - 1, sieving_strategy::thread_count(this->__th), 64);
+
+            char widest[24];
+            llong width = std::to_chars(widest, widest + sizeof(widest), (uint64_t)(_base + _len - 1)).ptr - widest + 1;
+
+            /* ========================================================================================== */
+            /* Exact count of primes in every slice (by popcount) bounds its text - all buffers are taken */
+            /* from arena before any thread starts, so failed allocation leaves no thread behind          */
+            /* ========================================================================================== */
+            util::arena::scope scratch(this->__arena);
+            std::vector<llong> counts(parts.size());
+            auto args = scratch.alloc<slice>(parts.size());
+            for (size_t i = 0; i < parts.size(); i++)
+            {
+                counts[i] = sieving_strategy::storage::bit::count(_words, parts[i].first, parts[i].second);
+                char* text = scratch.alloc<char>((size_t)(counts[i] * width));
+                args[i] = slice{ _words, _base, parts[i].first, parts[i].second, text, text + counts[i] * width, 0 };
+            }
+
+            std::vector<i_op::thread> threads;
+            for (size_t i = 0; i < parts.size(); i++)
+            {
+                threads.push_back(i_op::thread{ thread_format, &args[i] }.start());
+            }
+
+            /* ============================================================= */
+            /* Write slices in order, each one as soon as its thread is done */
+            /* ============================================================= */
+            for (size_t i = 0; i < parts.size(); i++)
+            {
+                threads[i].join();
+                this->__out.write(args[i].text, args[i].len);
+                this->__count += counts[i];
+            }
+        }
+    };
+}
@@ -0,0 +1,373 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <new>
+
+#include "interoperability/thread.hpp"
+#include "util/memory.hpp"
+#include "sieving_strategies.hpp"
+
+/* ============================================================================================== */
+/* Sieve of values of quadratic polynomials f(k) = a k^2 + b k + c, for k = 0..K - such as        */
+/* diagonals of Ulam Spiral (4k^2 + bk + c). Instead of sieving every number up to f(K), roots of */
+/* f(k) = 0 (mod p) are found for every base prime p, and k in these residue classes are marked - */
+/* so sieve holds K + 1 entries, not f(K)                                                         */
+/* ============================================================================================== */
+namespace poly
+{
+    typedef long long llong;
+
+    /// @brief Largest value of polynomial that may be sieved - keeps every calculation within `llong`
+    constexpr double Value_Limit = 4e18;
+
+    /**
+     * @brief Polynomial a k^2 + b k + c, with `a` positive
+     */
+    struct quadratic
+    {
+        llong a;
+        llong b;
+        llong c;
+
+        llong operator ()(llong _k) const { return (this->a * _k + this->b) * _k + this->c; }
+    };
+
+    /**
+     * @return Whether every value of `_f` for k = 0..`_k` stays within `Value_Limit`
+     */
+    inline bool fits(quadratic const& _f, llong _k)
+    {
+        auto value = [&](double _x) { return ((double)_f.a * _x + (double)_f.b) * _x + (double)_f.c; };
+        return _f.a > 0 && std::abs(value(0)) <= Value_Limit && std::abs(value((double)_k)) <= Value_Limit;
+    }
+
+    /**
+     * @return `_b` to the power of `_e`, modulo `_m` (below 2^32)
+     */
+    inline uint64_t pow_mod(uint64_t _b, uint64_t _e, uint64_t _m)
+    {
+        uint64_t r = 1 % _m;
+        _b %= _m;
+        for (; _e > 0; _e >>= 1)
+        {
+            if (_e & 1) { r = r * _b % _m; }
+            _b = _b * _b % _m;
+        }
+        return r;
+    }
+
+    /**
+     * @brief Finds square root of `_n` modulo odd prime `_p` (below 2^32). For `_p` = 3 (mod 4) and `_p` = 5
+     *      (mod 8) - three quarters of primes - root is given by single exponentiation, and checked afterwards.
+     *      Other primes go through Tonelli-Shanks algorithm
+     *
+     * @return `false` if `_n` is not a quadratic residue
+     */
+    inline bool sqrt_mod(uint64_t _n, uint64_t _p, uint64_t& _root)
+    {
+        _n %= _p;
+        if (_n == 0) { _root = 0; return true; }
+        if (_p % 4 == 3)
+        {
+            _root = pow_mod(_n, (_p + 1) / 4, _p);
+            return _root * _root % _p == _n;
+        }
+        if (_p % 8 == 5)
+        {
+            uint64_t v = pow_mod(2 * _n % _p, (_p - 5) / 8, _p);
+            uint64_t i = 2 * _n % _p * v % _p * v % _p;
+            _root = _n * v % _p * ((i + _p - 1) % _p) % _p;
+            return _root * _root % _p == _n;
+        }
+        if (pow_mod(_n, (_p - 1) / 2, _p) != 1) { return false; }
+
+        uint64_t q = _p - 1;
+        int s = 0;
+        while (q % 2 == 0) { q /= 2; s++; }
+
+        uint64_t z = 2;
+        while (pow_mod(z, (_p - 1) / 2, _p) != _p - 1) { z++; }
+
+        uint64_t m = s;
+        uint64_t c = pow_mod(z, q, _p);
+        uint64_t t = pow_mod(_n, q, _p);
+        uint64_t r = pow_mod(_n, (q + 1) / 2, _p);
+        while (t != 1)
+        {
+            uint64_t i = 0;
+            for (uint64_t t2 = t; t2 != 1; t2 = t2 * t2 % _p) { i++; }
+            uint64_t b = pow_mod(c, (uint64_t)1 << (m - i - 1), _p);
+            m = i;
+            c = b * b % _p;
+            t = t * c % _p;
+            r = r * b % _p;
+        }
+        _root = r;
+        return true;
+    }
+
+    /// @brief Returned by `roots` when every `k` is a root
+    constexpr int All = -1;
+
+    /**
+     * @brief Solves `_f(k) = 0 (mod _p)`
+     *
+     * @param _roots receives distinct roots in 0..`_p - 1`
+     * @return Count of roots (0..2), or `All`
+     */
+    inline int roots(quadratic const& _f, uint64_t _p, uint64_t _roots[2])
+    {
+        auto mod = [&](llong _x) { return (uint64_t)((_x % (llong)_p + (llong)_p) % (llong)_p); };
+        uint64_t a = mod(_f.a);
+        uint64_t b = mod(_f.b);
+        uint64_t c = mod(_f.c);
+
+        if (_p == 2)
+        {
+            int cnt = 0;
+            for (uint64_t k = 0; k < 2; k++)
+            {
+                if ((a * k + b * k + c) % 2 == 0) { _roots[cnt++] = k; }
+            }
+            return cnt == 2 ? All : cnt;
+        }
+
+        /* ================================================ */
+        /* Polynomial degenerates to linear one modulo `_p` */
+        /* ================================================ */
+        if (a == 0)
+        {
+            if (b == 0) { return c == 0 ? All : 0; }
+            _roots[0] = (_p - c) % _p * pow_mod(b, _p - 2, _p) % _p;
+            return 1;
+        }
+
+        /* ================================================== */
+        /* k = (-b +- sqrt(b^2 - 4ac)) / 2a, in field of `_p` */
+        /* ================================================== */
+        uint64_t disc = (b * b % _p + _p - 4 * a % _p * c % _p) % _p;
+        uint64_t s;
+        if (!sqrt_mod(disc, _p, s)) { return 0; }
+
+        uint64_t inv = pow_mod(2 * a % _p, _p - 2, _p);
+        _roots[0] = (_p - b + s) % _p * inv % _p;
+        _roots[1] = (2 * _p - b - s) % _p * inv % _p;
+        return _roots[0] == _roots[1] ? 1 : 2;
+    }
+
+    /**
+     * @brief Primes among values of single polynomial
+     */
+    struct diagonal
+    {
+        quadratic f;
+        /// @brief Count of values that are prime
+        llong primes;
+        /// @brief Count of values sieved (k = 0..K)
+        llong values;
+        /// @brief Count of primes expected by prime number theorem - sum of 1 / ln f(k), for values above 1
+        double expected;
+    };
+
+    /// @brief Entry of root table, for root that does not exist
+    constexpr uint32_t None = UINT32_MAX;
+
+    /**
+     * @brief Range of base primes, for which roots are found by single thread
+     */
+    struct root_slice
+    {
+        /// @brief Index of first prime of slice
+        llong begin;
+        /// @brief Index of last prime of slice (inclusive)
+        llong end;
+        quadratic const* f;
+        std::vector<uint32_t> const* primes;
+        /// @brief Table of roots, two entries per prime (`None` if missing)
+        uint32_t* roots;
+        /// @brief Whether any prime divides every value (output)
+        bool every;
+    };
+
+    /**
+     * @brief Runnable thread function, that fills root table for given primes
+     *
+     * @param _slice `poly::root_slice*` casted to `void*`
+     * @return `i_op::thread::OS_Runnable_OK`
+     */
+    auto thread_roots(void* _slice)
+    {
+        auto slice = (root_slice*)_slice;
+        slice->every = false;
+
+        uint64_t r[2];
+        for (llong i = slice->begin; i <= slice->end; i++)
+        {
+            int cnt = roots(*slice->f, (*slice->primes)[i], r);
+            if (cnt == All)
+            {
+                slice->every = true;
+                cnt = 0;
+            }
+            slice->roots[2 * i] = cnt > 0 ? (uint32_t)r[0] : None;
+            slice->roots[2 * i + 1] = cnt > 1 ? (uint32_t)r[1] : None;
+        }
+
+        return i_op::thread::OS_Runnable_OK;
+    }
+
+    /**
+     * @brief Range of `k`, sieved and counted by single thread
+     */
+    struct slice
+    {
+        /// @brief First `k` of slice (multiple of 64)
+        llong from;
+        /// @brief Last `k` of slice (inclusive)
+        llong to;
+        quadratic const* f;
+        /// @brief Bit sieve of values, where bit `k` is set if `f(k)` is composite
+        uint64_t* words;
+        std::vector<uint32_t> const* primes;
+        /// @brief Table of roots, filled by `thread_roots`
+        uint32_t const* roots;
+        /// @brief Whether some prime divides every value
+        bool every;
+        /// @brief Bit sieve of numbers 0..`small_n`, that holds base primes
+        uint64_t const* small;
+        llong small_n;
+        /// @brief Count of primes in slice (output)
+        llong count;
+        /// @brief Sum of 1 / ln f(k) over slice (output)
+        double expected;
+    };
+
+    /**
+     * @brief Runnable thread function, that marks values with prime divisor in slice, then counts primes
+     *      among them. Value `f(k)` small enough to be base prime itself is not marked by its own
+     *      divisor - such values are looked up in `small` sieve instead
+     *
+     * @param _slice `poly::slice*` casted to `void*`
+     * @return `i_op::thread::OS_Runnable_OK`
+     */
+    auto thread_sieve(void* _slice)
+    {
+        auto slice = (struct slice*)_slice;
+        auto const& f = *slice->f;
+        for (llong w = slice->from / 64; w <= slice->to / 64; w++) { slice->words[w] = slice->every ? ~(uint64_t)0 : 0; }
+
+        auto const& primes = *slice->primes;
+        for (size_t i = 0; i < primes.size() && !slice->every; i++)
+        {
+            llong p = primes[i];
+            for (int j = 0; j < 2; j++)
+            {
+                uint32_t r = slice->roots[2 * i + j];
+                if (r == None) { continue; }
+                for (llong k = slice->from + (r + p - slice->from % p) % p; k <= slice->to; k += p)
+                {
+                    sieving_strategy::storage::bit::mark(slice->words, k);
+                }
+            }
+        }
+
+        slice->count = 0;
+        slice->expected = 0;
+        for (llong k = slice->from; k <= slice->to; k++)
+        {
+            llong v = f(k);
+            if (v < 2) { continue; }
+
+            slice->expected += 1 / std::log((double)v);
+            if (v <= slice->small_n)
+            {
+                slice->count += sieving_strategy::storage::bit::is_prime(slice->small, v);
+            }
+            else
+            {
+                slice->count += sieving_strategy::storage::bit::is_prime(slice->words, k);
+            }
+        }
+
+        return i_op::thread::OS_Runnable_OK;
+    }
+
+    /**
+     * @brief Sieves values of every polynomial in `_polys` for k = 0..`_k`, with up to `_th` threads (-1 for all
+     *      available). For every polynomial, roots are found once, with base primes divided between threads -
+     *      then each thread marks and counts own slice of `k`, so no synchronization is needed
+     *
+     * Every polynomial must pass `fits`. Base primes go up to square root of largest value, and are sieved once.
+     *
+     * @throw std::bad_alloc – if memory for sieve cannot be allocated
+     */
+    std::vector<diagonal> diagonals(std::vector<quadratic> const& _polys, llong _k, int _th = -1)
+    {
+        llong top = 2;
+        for (auto const& f : _polys)
+        {
+            top = std::max({ top, std::abs(f(0)), std::abs(f(_k)) });
+        }
+        llong sqr = std::sqrt((double)top);
+        while (sqr * sqr > top) { sqr--; }
+        while ((sqr + 1) * (sqr + 1) <= top) { sqr++; }
+
+        auto small = util::mem<uint64_t>::calloc(sqr / 64 + 1);
+        auto words = util::mem<uint64_t>::calloc(_k / 64 + 1);
+        if (small.ptr() == nullptr || words.ptr() == nullptr)
+        {
+            small.free();
+            words.free();
+            throw std::bad_alloc();
+        }
+        sieving_strategy::single_thread<llong, sieving_strategy::storage::bit>(sqr, small);
+        auto primes = sieving_strategy::base_primes<sieving_strategy::storage::bit>(small, sqr);
+        std::vector<uint32_t> roots(2 * primes.size());
+
+        std::vector<diagonal> result;
+        int thread_cnt = sieving_strategy::thread_count(_th);
+        auto parts = sieving_strategy::partition(0, _k, thread_cnt, 64);
+        auto prime_parts = sieving_strategy::partition(0, (llong)primes.size() - 1, thread_cnt, 1);
+        util::arena::scope scratch;
+        auto args = scratch.alloc<slice>(parts.size());
+        auto root_args = scratch.alloc<root_slice>(prime_parts.size());
+        for (auto const& f : _polys)
+        {
+            std::vector<i_op::thread> threads;
+            for (size_t i = 0; i < prime_parts.size(); i++)
+            {
+                root_args[i] = root_slice{ prime_parts[i].first, prime_parts[i].second, &f, &primes, roots.data(), false };
+                threads.push_back(i_op::thread{ thread_roots, &root_args[i] }.start());
+            }
+            bool every = false;
+            for (size_t i = 0; i < prime_parts.size(); i++)
+            {
+                threads[i].join();
+                every = every || root_args[i].every;
+            }
+
+            threads.clear();
+            for (size_t i = 0; i < parts.size(); i++)
+            {
+                args[i] = slice{ parts[i].first, parts[i].second, &f, words.ptr(), &primes, roots.data(), every, small.ptr(), sqr, 0, 0 };
+                threads.push_back(i_op::thread{ thread_sieve, &args[i] }.start());
+            }
+
+            diagonal d{ f, 0, _k + 1, 0 };
+            for (size_t i = 0; i < parts.size(); i++)
+            {
+                threads[i].join();
+                d.primes += args[i].count;
+                d.expected += args[i].expected;
+            }
+            result.push_back(d);
+        }
+
+        words.free();
+        small.free();
+        return result;
+    }
+}
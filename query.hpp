@@ -0,0 +1,262 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <new>
+#include <algorithm>
+
+#include "interoperability/thread.hpp"
+#include "util/memory.hpp"
+#include "sieving_strategies.hpp"
+
+namespace query
+{
+    typedef long long llong;
+
+    /// @brief Count of sieve bits covered by single entry of rank index
+    constexpr llong Rank_Block = 512;
+    /// @brief Count of sieve words covered by single entry of rank index
+    constexpr llong Rank_Words = Rank_Block / 64;
+
+    /**
+     * @brief Range of blocks of rank index, processed by single thread
+     */
+    struct rank_slice
+    {
+        /// @brief First block of slice
+        llong begin;
+        /// @brief Last block of slice (inclusive)
+        llong end;
+        /// @brief Words of bit sieve
+        uint64_t const* words;
+        /// @brief Count of words in sieve
+        llong len;
+        /// @brief Rank index being built
+        llong* ranks;
+        /// @brief First pass: count of primes in slice (output). Second pass: count of primes before slice (input)
+        llong sum;
+        /// @brief Whether second pass is performed
+        bool offset;
+    };
+
+    /**
+     * @brief Runnable thread function, that builds rank index of given slice in two passes - first
+     *      one writes counts relative to beginning of slice and sums them, second one adds count of
+     *      primes in all preceding slices (once those are known)
+     *
+     * @param _slice `query::rank_slice*` casted to `void*`
+     * @return `i_op::thread::OS_Runnable_OK`
+     */
+    auto thread_rank(void* _slice)
+    {
+        auto slice = (rank_slice*)_slice;
+
+        if (slice->offset)
+        {
+            for (llong b = slice->begin; b <= slice->end; b++) { slice->ranks[b] += slice->sum; }
+            return i_op::thread::OS_Runnable_OK;
+        }
+
+        llong sum = 0;
+        for (llong b = slice->begin; b <= slice->end; b++)
+        {
+            slice->ranks[b] = sum;
+            llong last = std::min((b + 1) * Rank_Words, slice->len);
+            for (llong w = b * Rank_Words; w < last; w++) { sum += __builtin_popcountll(~slice->words[w]); }
+        }
+        slice->sum = sum;
+        return i_op::thread::OS_Runnable_OK;
+    }
+
+    /**
+     * @brief Resident, bit-packed sieve of range 0..n, that answers queries about primes in it
+     */
+    class table
+    {
+    private:
+        llong __n;
+        util::mem<uint64_t> __bits;
+        /// @brief Words of `__bits`, for use in `const` queries
+        uint64_t const* __words;
+        /// @brief Count of primes before every block of `Rank_Block` numbers, and total count as last element
+        util::mem<llong> __ranks;
+        /// @brief Elements of `__ranks`, for use in `const` queries
+        llong const* __rank_of;
+        /// @brief Count of blocks in rank index (excluding total count)
+        llong __blocks;
+
+        table(table const&) = delete;
+
+        /**
+         * @brief Builds `__ranks` with up to `_th` threads - each one counts primes of its blocks, and after
+         *      prefix sum of those counts is taken, adds count of primes preceding its blocks
+         */
+        void build_ranks(int _th)
+        {
+            llong blocks = this->__blocks;
+            auto parts = sieving_strategy::partition(0, blocks - 1, sieving_strategy::thread_count(_th), 1);
+            util::arena::scope scratch;
+            auto args = scratch.alloc<rank_slice>(parts.size());
+
+            for (bool offset : { false, true })
+            {
+                std::vector<i_op::thread> threads;
+                llong sum = 0;
+                for (size_t i = 0; i < parts.size(); i++)
+                {
+                    if (offset)
+                    {
+                        llong cnt = args[i].sum;
+                        args[i].sum = sum;
+                        args[i].offset = true;
+                        sum += cnt;
+                    }
+                    else
+                    {
+                        args[i] = rank_slice{
+                            parts[i].first,
+                            parts[i].second,
+                            this->__words,
+                            (llong)this->__bits.len(),
+                            this->__ranks.ptr(),
+                            0,
+                            false
+                        };
+                    }
+                    threads.push_back(i_op::thread{ thread_rank, &args[i] }.start());
+                }
+                for (auto th : threads)
+                {
+                    th.join();
+                }
+                if (offset) { this->__ranks.ptr()[blocks] = sum; }
+            }
+        }
+
+
+    public:
+        /**
+         * @brief Sieves range 0..`_n` into new table, and builds its rank index
+         *
+         * @param _th max threads used for sieving (-1 for all available)
+         * @param _seg segment size passed to `sieving_strategy::multi_thread`
+         * @throw std::bad_alloc – if memory for sieve cannot be allocated
+         */
+        table(llong _n, int _th = -1, llong _seg = 0):
+            __n(_n), __bits(util::mem<uint64_t>::calloc(_n / 64 + 1)),
+            __ranks(util::mem<llong>::calloc((_n / 64 + Rank_Words) / Rank_Words + 1))
+        {
+            if (this->__bits.ptr() == nullptr || this->__ranks.ptr() == nullptr)
+            {
+                this->__bits.free();
+                this->__ranks.free();
+                throw std::bad_alloc();
+            }
+            this->__words = this->__bits.ptr();
+            this->__rank_of = this->__ranks.ptr();
+            this->__blocks = (llong)this->__ranks.len() - 1;
+
+            if (_n < sieving_strategy::Narrow_Limit)
+            {
+                sieving_strategy::multi_thread<uint32_t, sieving_strategy::storage::bit>(_n, this->__bits, _th, _seg);
+            }
+            else
+            {
+                sieving_strategy::multi_thread<llong, sieving_strategy::storage::bit>(_n, this->__bits, _th, _seg);
+            }
+
+            /* =============================================================================== */
+            /* Numbers past `_n` in last word are marked composite, so that whole words can be */
+            /* counted without masking                                                         */
+            /* =============================================================================== */
+            for (llong x = _n + 1; x < (llong)this->__bits.len() * 64; x++)
+            {
+                sieving_strategy::storage::bit::mark(this->__bits.ptr(), x);
+            }
+
+            this->build_ranks(_th);
+        }
+
+        ~table()
+        {
+            this->__bits.free();
+            this->__ranks.free();
+        }
+
+        /// @return Upper bound of sieved range
+        llong n() const { return this->__n; }
+
+        /**
+         * @return Whether `_x` is prime - `_x` must be in range 0..n
+         */
+        bool is_prime(llong _x) const
+        {
+            return sieving_strategy::storage::bit::is_prime(this->__words, _x);
+        }
+
+        /**
+         * @return Count of primes not greater than `_x` - `_x` must be in range 0..n. Takes rank of
+         *      block containing `_x`, and popcount of at most `Rank_Words` words within it
+         */
+        llong pi(llong _x) const
+        {
+            llong block = _x / Rank_Block;
+            return this->__rank_of[block]
+                + sieving_strategy::storage::bit::count(this->__words, block * Rank_Block, _x);
+        }
+
+        /**
+         * @return `_k`-th prime (counting from 1, so that `nth_prime(1) == 2`), or `-1` if there are less
+         *      than `_k` primes in range. Block containing it is found by binary search over rank index
+         */
+        llong nth_prime(llong _k) const
+        {
+            llong const* ranks = this->__rank_of;
+            llong blocks = this->__blocks;
+            if (_k < 1 || ranks[blocks] < _k) { return -1; }
+
+            /* ======================================================== */
+            /* Last block, before which there are less than `_k` primes */
+            /* ======================================================== */
+            llong block = std::upper_bound(ranks, ranks + blocks, _k - 1) - ranks - 1;
+            _k -= ranks[block];
+
+            for (llong w = block * Rank_Words; ; w++)
+            {
+                uint64_t primes = ~this->__words[w];
+                llong cnt = __builtin_popcountll(primes);
+                if (_k > cnt)
+                {
+                    _k -= cnt;
+                    continue;
+                }
+                for (; _k > 1; _k--) { primes &= primes - 1; }
+                return w * 64 + __builtin_ctzll(primes);
+            }
+        }
+
+        /**
+         * @return Primes in range `_a`..`_b` (inclusive), both of which must be in range 0..n. Whole words are
+         *      walked, taking one prime per set bit
+         */
+        std::vector<llong> primes_in(llong _a, llong _b) const
+        {
+            std::vector<llong> primes;
+            if (_a > _b) { return primes; }
+            primes.reserve(this->pi(_b) - (_a > 0 ? this->pi(_a - 1) : 0));
+
+            for (llong w = _a / 64; w * 64 <= _b; w++)
+            {
+                uint64_t bits = ~this->__words[w];
+                if (w == _a / 64) { bits &= ~(uint64_t)0 << (_a % 64); }
+                if (_b - w * 64 < 63) { bits &= ((uint64_t)1 << (_b - w * 64 + 1)) - 1; }
+                while (bits != 0)
+                {
+                    primes.push_back(w * 64 + __builtin_ctzll(bits));
+                    bits &= bits - 1;
+                }
+            }
+            return primes;
+        }
+    };
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "interoperability/socket.hpp"
+#include "util/ansi_text.hpp"
+#include "query.hpp"
+
+/* ========================================================================================================== */
+/* Prime query daemon - keeps `query::table` resident and answers requests of any number of clients connected */
+/* over local socket. Protocol is line-based text, one request per line, one reply line per request:          */
+/*                                                                                                            */
+/*     is_prime [x]        ->  1 or 0                                                                         */
+/*     pi [x]              ->  count of primes <= x                                                           */
+/*     nth_prime [k]       ->  k-th prime (nth_prime 1 == 2)                                                  */
+/*     primes_in [a] [b]   ->  primes in a..b, separated by spaces (at most `Max_Primes` of them)             */
+/*     shutdown            ->  `ok', then daemon terminates                                                   */
+/*                                                                                                            */
+/* Invalid requests get reply starting with `error:'. Replies are queued per client, and sent only as fast as */
+/* client reads them - so single slow (or stuck) client never stalls others                                   */
+/* ========================================================================================================== */
+namespace server
+{
+    typedef long long llong;
+
+    /// @brief Max length of single request line - longer ones are rejected and connection is closed
+    constexpr size_t Max_Line = 4096;
+    /// @brief Max count of primes in reply to `primes_in` - larger ranges must be asked for in parts
+    constexpr llong Max_Primes = 1 << 20;
+    /// @brief Size of unsent replies, above which requests of client are not read until it catches up
+    constexpr size_t Max_Pending = 1 << 20;
+
+    /**
+     * @brief Answers single request line
+     *
+     * @param _shutdown set to `true` if request asks daemon to terminate
+     * @return Reply line, without trailing new line
+     */
+    std::string answer(query::table const& _table, std::string const& _line, bool& _shutdown)
+    {
+        std::istringstream in(_line);
+        std::string cmd;
+        in >> cmd;
+
+        std::vector<llong> args;
+        llong arg;
+        while (in >> arg) { args.push_back(arg); }
+        if (!in.eof()) { return "error: arguments must be integers"; }
+
+        auto in_range = [&](llong _x) { return 0 <= _x && _x <= _table.n(); };
+        std::string range_err = "error: argument out of range 0.." + std::to_string(_table.n());
+
+        if (cmd == "is_prime" && args.size() == 1)
+        {
+            if (!in_range(args[0])) { return range_err; }
+            return _table.is_prime(args[0]) ? "1" : "0";
+        }
+        if (cmd == "pi" && args.size() == 1)
+        {
+            if (!in_range(args[0])) { return range_err; }
+            return std::to_string(_table.pi(args[0]));
+        }
+        if (cmd == "nth_prime" && args.size() == 1)
+        {
+            llong p = _table.nth_prime(args[0]);
+            if (p < 0) { return "error: no such prime in range 0.." + std::to_string(_table.n()); }
+            return std::to_string(p);
+        }
+        if (cmd == "primes_in" && args.size() == 2)
+        {
+            if (!in_range(args[0]) || !in_range(args[1])) { return range_err; }
+            llong count = args[0] > args[1] ? 0 : _table.pi(args[1]) - (args[0] > 0 ? _table.pi(args[0] - 1) : 0);
+            if (count > Max_Primes) { return "error: range holds more than " + std::to_string(Max_Primes) + " primes"; }
+            std::string reply;
+            for (llong p : _table.primes_in(args[0], args[1]))
+            {
+                if (!reply.empty()) { reply += ' '; }
+                reply += std::to_string(p);
+            }
+            return reply;
+        }
+        if (cmd == "shutdown" && args.empty())
+        {
+            _shutdown = true;
+            return "ok";
+        }
+        return "error: unknown request `" + _line + "'";
+    }
+
+    /**
+     * @brief Client connection, part of request line received so far, and replies not sent yet
+     */
+    struct client
+    {
+        i_op::local_socket sock;
+        std::string buf;
+        std::string out;
+
+        /// @brief Sends as much of queued replies, as socket accepts without waiting
+        void flush()
+        {
+            size_t sent = 0;
+            size_t got;
+            while (sent < this->out.size() && (got = this->sock.send_some(this->out.data() + sent, this->out.size() - sent)) > 0)
+            {
+                sent += got;
+            }
+            this->out.erase(0, sent);
+        }
+
+        /**
+         * @brief Answers complete request lines while queue of replies is short (rest of them wait until it gets
+         *      shorter), and sends as much of replies, as socket accepts
+         *
+         * @param _shutdown set to `true` if any request asks daemon to terminate
+         * @return `false` if incomplete line is longer than `Max_Line`
+         */
+        bool answer_lines(query::table const& _table, bool& _shutdown)
+        {
+            size_t nl;
+            while (this->out.size() < Max_Pending && (nl = this->buf.find('\n')) != std::string::npos)
+            {
+                std::string line = this->buf.substr(0, nl);
+                if (!line.empty() && line.back() == '\r') { line.pop_back(); }
+                this->buf.erase(0, nl + 1);
+                this->out += answer(_table, line, _shutdown) + "\n";
+            }
+            this->flush();
+            return this->buf.size() <= Max_Line || this->buf.find('\n') != std::string::npos;
+        }
+    };
+
+    /**
+     * @brief Listens on `_path`, and answers requests until `shutdown` request arrives
+     *
+     * @param _log stream for progress messages
+     * @throw i_op::error_msg – if listening socket cannot be created
+     */
+    void serve(char const* _path, query::table const& _table, std::ostream& _log)
+    {
+        auto listener = i_op::local_socket::listen(_path);
+        std::vector<client> clients;
+        bool shutdown = false;
+
+        _log
+            << ANSI::b_green << "Serving primes in range 0.." << _table.n() << " on "
+            << ANSI::reset << _path << "\n";
+
+        while (!shutdown)
+        {
+            /* ================================================================================= */
+            /* Clients are read only while their queue of replies is short, and wait for writing */
+            /* only while it is not empty                                                        */
+            /* ================================================================================= */
+            std::vector<i_op::local_socket const*> socks{ &listener };
+            std::vector<unsigned> conditions{ i_op::local_socket::Readable };
+            for (auto& c : clients)
+            {
+                socks.push_back(&c.sock);
+                conditions.push_back((c.out.size() < Max_Pending ? i_op::local_socket::Readable : 0)
+                    | (c.out.empty() ? 0 : i_op::local_socket::Writable));
+            }
+
+            auto state = i_op::local_socket::wait(socks, conditions);
+            std::vector<bool> closed(clients.size(), false);
+            for (size_t r = 0; r < state.size(); r++)
+            {
+                if (state[r] == 0) { continue; }
+                if (r == 0)
+                {
+                    clients.push_back(client{ listener.accept(), "", "" });
+                    closed.push_back(false);
+                    continue;
+                }
+
+                /* ============================================================================= */
+                /* Send queued replies, then read what is available, and answer complete lines - */
+                /* rest waits for more                                                           */
+                /* ============================================================================= */
+                auto& c = clients[r - 1];
+                try
+                {
+                    if (state[r] & i_op::local_socket::Writable) { c.answer_lines(_table, shutdown); }
+                    if ((state[r] & i_op::local_socket::Readable) == 0) { continue; }
+
+                    char chunk[4096];
+                    size_t got = c.sock.receive_some(chunk, sizeof(chunk));
+                    if (got == 0)
+                    {
+                        closed[r - 1] = true;
+                        continue;
+                    }
+                    c.buf.append(chunk, got);
+                    if (!c.answer_lines(_table, shutdown)) { closed[r - 1] = true; }
+                }
+                catch (i_op::error_msg const&)
+                {
+                    closed[r - 1] = true;
+                }
+            }
+
+            for (size_t i = clients.size(); i-- > 0;)
+            {
+                if (closed[i]) { clients.erase(clients.begin() + i); }
+            }
+        }
+
+        _log << ANSI::b_blue << "Shutting down per request" << ANSI::reset << "\n";
+    }
+
+    /**
+     * @brief Sends single request to daemon listening on `_path`, and waits for reply
+     *
+     * @return Reply line, without trailing new line
+     * @throw i_op::error_msg – if daemon cannot be reached
+     */
+    std::string request(char const* _path, std::string const& _line)
+    {
+        auto sock = i_op::local_socket::connect(_path);
+        std::string req = _line + "\n";
+        sock.send(req.data(), req.size());
+
+        std::string reply;
+        char chunk[4096];
+        size_t got;
+        while (reply.find('\n') == std::string::npos && (got = sock.receive_some(chunk, sizeof(chunk))) > 0)
+        {
+            reply.append(chunk, got);
+        }
+        if (!reply.empty() && reply.back() == '\n') { reply.pop_back(); }
+        return reply;
+    }
+}
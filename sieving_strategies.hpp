@@ -5,10 +5,14 @@
 #include <climits>
 #include <cmath>
 #include <vector>
+#include <utility>
+#include <cstdint>
+#include <algorithm>
 
 #include "interoperability/thread.hpp"
 #include "interoperability/process.hpp"
 #include "util/memory.hpp"
+#include "util/popcount.hpp"
 
 namespace sieving_strategy
 {
@@ -32,6 +36,25 @@ namespace sieving_strategy
         llong ns_mc;
     };
     
+    /**
+     * @brief Topology of host, queried once - used for sizing of segments to caches
+     */
+    inline i_op::cpu_topology const& topology()
+    {
+        static i_op::cpu_topology topo = i_op::process::get_CPU_topology();
+        return topo;
+    }
+
+    /**
+     * @brief Number of threads to spawn for requested `_th` - which is limited by CPUs available to this
+     * process (affinity and cgroup quota), `-1` meaning all of those
+     */
+    inline int thread_count(int _th)
+    {
+        int available = (int)i_op::process::get_available_CPU_count();
+        return _th == -1 ? available : std::min(_th, available);
+    }
+
     namespace num
     {
         constexpr char Root = '@';
@@ -39,25 +62,121 @@ namespace sieving_strategy
         constexpr char Composite = '`';
     }
 
+    /**
+     * @brief Largest `n` (exclusive) for which kernels can use 32-bit indices - headroom of 2^17 keeps every
+     * multiple visited (at most `n` plus prime below 2^16) from wrapping around
+     */
+    constexpr llong Narrow_Limit = (1LL << 32) - (1LL << 17);
+
+    /**
+     * @brief Storage policies of sieve - define type of memory word, and how numbers are kept in words
+     */
+    namespace storage
+    {
+        /**
+         * @brief One `char` per number, holding one of `num` values - format expected by `ulam`
+         */
+        struct byte
+        {
+            typedef char word;
+            /// @brief Count of numbers held by single word
+            static constexpr llong Per_Word = 1;
+
+            /// @brief Marks every number as prime, and 1 as root - `_sieve` holds numbers from `_base` onwards
+            static void init(util::mem<word>& _sieve, llong _base = 0)
+            {
+                for (auto& i : _sieve)
+                {
+                    i = num::Prime;
+                }
+                if (_base <= 1 && 1 - _base < (llong)_sieve.len()) { _sieve.ptr()[1 - _base] = num::Root; }
+            }
+
+            template<typename I>
+            static bool is_prime(word const* _sieve, I _i) { return _sieve[_i] == num::Prime; }
+
+            template<typename I>
+            static void mark(word* _sieve, I _i) { _sieve[_i] = num::Composite; }
+
+            /// @return Count of primes at indices `_from`..`_to` (inclusive)
+            static llong count(word const* _sieve, llong _from, llong _to)
+            {
+                llong cnt = 0;
+                for (llong i = _from; i <= _to; i++)
+                {
+                    cnt += _sieve[i] == num::Prime;
+                }
+                return cnt;
+            }
+        };
+
+        /**
+         * @brief One bit per number, set for composites (and for 0 and 1) - 8 times more compact than `byte`.
+         * Memory must hold `n / 64 + 1` words
+         */
+        struct bit
+        {
+            typedef uint64_t word;
+            /// @brief Count of numbers held by single word
+            static constexpr llong Per_Word = 64;
+
+            /// @brief Marks every number as prime, except for 0 and 1 - `_sieve` holds numbers from `_base` onwards
+            static void init(util::mem<word>& _sieve, llong _base = 0)
+            {
+                for (auto& w : _sieve)
+                {
+                    w = 0;
+                }
+                for (llong i = std::max(0LL, _base); i <= 1 && i - _base < (llong)_sieve.len() * Per_Word; i++)
+                {
+                    mark(_sieve.ptr(), i - _base);
+                }
+            }
+
+            template<typename I>
+            static bool is_prime(word const* _sieve, I _i) { return !((_sieve[_i >> 6] >> (_i & 63)) & 1); }
+
+            template<typename I>
+            static void mark(word* _sieve, I _i) { _sieve[_i >> 6] |= (word)1 << (_i & 63); }
+
+            /// @return Count of primes at indices `_from`..`_to` (inclusive) - by popcount of whole words, where
+            ///     words between first and last one go through `util::popcount` (vectorized if host allows)
+            static llong count(word const* _sieve, llong _from, llong _to)
+            {
+                if (_from > _to) { return 0; }
+                llong first = _from >> 6;
+                llong last = _to >> 6;
+
+                word head = ~_sieve[first] & (~(word)0 << (_from & 63));
+                word tail = (_to & 63) == 63 ? ~(word)0 : ((word)1 << ((_to & 63) + 1)) - 1;
+                if (first == last) { return __builtin_popcountll(head & tail); }
+
+                llong inner = last - first - 1;
+                return __builtin_popcountll(head) + __builtin_popcountll(~_sieve[last] & tail)
+                    + inner * 64 - (llong)util::popcount(_sieve + first + 1, (size_t)inner);
+            }
+        };
+    }
+
 
 
     /**
      * @brief Performs calculation on `_n` numbers, saving results to `_sieve`.
      *
      * This functions runs single-threaded, and so there's nothing to adjust.
+     *
+     * @tparam I type of indices - `uint32_t` may be used if `_n < Narrow_Limit`
+     * @tparam S storage policy of `_sieve` (see `storage`)
      */
-    measure single_thread(llong _n, util::mem<char>& _sieve)
+    template<typename I = llong, typename S = storage::byte>
+    measure single_thread(llong _n, util::mem<typename S::word>& _sieve)
     {
         /* =============================================================================================== */
         /* Initialization phase - assumes every number is prime (until later it isn't) and marks 1 as root */
         /* =============================================================================================== */
         auto start_i = std::chrono::high_resolution_clock::now();
 
-        for (auto& i : _sieve)
-        {
-            i = num::Prime;
-        }
-        if (1 <= _n) { _sieve.ptr()[1] = num::Root; }
+        S::init(_sieve);
 
         auto end_i = std::chrono::high_resolution_clock::now();
 
@@ -68,13 +187,13 @@ namespace sieving_strategy
         /* ================================================================================================== */
         auto start_c = std::chrono::high_resolution_clock::now();
 
-        for (llong i = 2; i * i <= _n; i++)
+        for (I i = 2; (llong)i * i <= _n; i++)
         {
-            if (_sieve.ptr()[i] == num::Prime)
+            if (S::is_prime(_sieve.ptr(), i))
             {
-                for (llong j = i * i; j <= _n + 1; j += i)
+                for (I j = i * i; j <= (I)_n; j += i)
                 {
-                    _sieve.ptr()[j] = num::Composite;
+                    S::mark(_sieve.ptr(), j);
                 }
             }
         }
@@ -97,9 +216,142 @@ namespace sieving_strategy
 
 
 
+    /**
+     * @return Size of cache line of host in bytes - every slice of `char` sieve begins on one
+     */
+    inline llong cache_line()
+    {
+        return topology().line > 0 ? (llong)topology().line : 64;
+    }
+
+    /**
+     * @return Alignment and phase (see `partition`), in numbers, that make slices of sieve at `_ptr` begin
+     *      on cache lines
+     */
+    template<typename S>
+    inline std::pair<llong, llong> cache_alignment(typename S::word const* _ptr)
+    {
+        llong per_line = cache_line() / (llong)sizeof(typename S::word);
+        llong phase = (llong)((uintptr_t)_ptr % cache_line()) / (llong)sizeof(typename S::word);
+        return { per_line * S::Per_Word, phase * S::Per_Word };
+    }
+
+    /**
+     * @brief Divides range `_begin`..`_end` (inclusive) into at most `_parts` consecutive, disjoint slices
+     * of roughly equal length, that cover it exactly.
+     *
+     * Every slice but first begins at number `b` for which `(b + _phase) % _align == 0` - for `char`
+     * sieve, `_align` is cache line size and `_phase` is address of sieve modulo that size, so that no
+     * two slices share a cache line. For bit-packed sieve `_align` of 64 makes slices begin on
+     * 64-bit words. Slices that would become empty after alignment are skipped.
+     *
+     * @return Bounds (both inclusive) of slices, in order
+     */
+    std::vector<std::pair<llong, llong>> partition(llong _begin, llong _end, int _parts, llong _align, llong _phase = 0)
+    {
+        std::vector<std::pair<llong, llong>> parts;
+        llong len = _end - _begin + 1;
+        llong prev = _begin;
+
+        for (int i = 1; i <= _parts && len > 0; i++)
+        {
+            llong cut = _end + 1;
+            if (i < _parts)
+            {
+                cut = _begin + len / _parts * i + len % _parts * i / _parts;
+                cut = ((cut + _phase + _align - 1) / _align) * _align - _phase;
+                cut = std::min(cut, _end + 1);
+            }
+            if (cut > prev)
+            {
+                parts.push_back({ prev, cut - 1 });
+                prev = cut;
+            }
+        }
+
+        return parts;
+    }
+
+    /**
+     * @brief Collects primes from already calculated range 2..`_sqr` of `_sieve` into compact list, which
+     * is shared read-only by all threads - so they neither rescan nor test the sieve itself
+     */
+    template<typename S = storage::byte>
+    std::vector<uint32_t> base_primes(util::mem<typename S::word>& _sieve, llong _sqr)
+    {
+        std::vector<uint32_t> primes;
+        for (llong i = 2; i <= _sqr; i++)
+        {
+            if (S::is_prime(_sieve.ptr(), i)) { primes.push_back((uint32_t)i); }
+        }
+        return primes;
+    }
+
+    /**
+     * @brief Calculates first multiple of every prime in `_primes` that is not below `_begin` (nor below
+     * square of that prime) - done once per thread, so that segments only advance these offsets
+     *
+     * @param _next array of `_primes.size()` elements to fill
+     */
+    template<typename I = llong>
+    inline void first_multiples(llong _begin, std::vector<uint32_t> const& _primes, I* _next)
+    {
+        for (size_t k = 0; k < _primes.size(); k++)
+        {
+            llong p = _primes[k];
+            _next[k] = (I)std::max(p * p, ((_begin + p - 1) / p) * p);
+        }
+    }
+
+    /**
+     * @brief Marks multiples of `_primes` up to `_hi` (inclusive) as composite, starting from `_next`
+     * offsets, which are advanced past `_hi` - so that following segment can continue from them
+     *
+     * @param _seg memory of segment, where number `j` is stored at index `j - _base` (of storage `S`)
+     */
+    template<typename I = llong, typename S = storage::byte>
+    inline void mark_segment(typename S::word* _seg, I _base, I _hi, std::vector<uint32_t> const& _primes, I* _next)
+    {
+        for (size_t k = 0; k < _primes.size(); k++)
+        {
+            I p = (I)_primes[k];
+            I j = _next[k];
+            for (; j <= _hi; j += p)
+            {
+                S::mark(_seg, (I)(j - _base));
+            }
+            _next[k] = j;
+        }
+    }
+
+    /**
+     * @brief Sieves short range `_lo`..`_hi` on calling thread, with base primes that are already known - for
+     * callers that sieve many small, scattered ranges, and cannot afford precalculation for every one of them.
+     * For `storage::bit`, `_lo` must be multiple of 64.
+     *
+     * @param _sieve memory of range, where number `j` is stored at index `j - _lo`
+     * @param _primes primes up to (at least) sqrt(`_hi`)
+     */
+    template<typename S = storage::byte>
+    inline void sieve_range(llong _lo, llong _hi, util::mem<typename S::word>& _sieve, std::vector<uint32_t> const& _primes)
+    {
+        S::init(_sieve, _lo);
+        for (llong p : _primes)
+        {
+            if (p * p > _hi) { break; }
+            for (llong j = std::max(p * p, ((_lo + p - 1) / p) * p); j <= _hi; j += p)
+            {
+                S::mark(_sieve.ptr(), j - _lo);
+            }
+        }
+    }
+
     /**
      * @brief Wrapper of arguments passed to calculation threads
+     *
+     * @tparam W type of memory word of sieve
      */
+    template<typename W = char>
     struct slice
     {
         /// @brief Lower, inclusive bound of slice
@@ -107,33 +359,44 @@ namespace sieving_strategy
         /// @brief Upper, inclusive bound of slice
         llong end;
         /// @brief Pointer to results
-        util::mem<char>* sieve;
+        util::mem<W>* sieve;
         /// @brief Sqrt(n) of numbers in `sieve`
         llong sqr;
+        /// @brief Count of numbers sieved at once, before moving to next segment (0 for whole slice)
+        llong seg = 0;
+        /// @brief Shared list of primes up to `sqr`
+        std::vector<uint32_t> const* primes = nullptr;
+        /// @brief Number stored at index 0 of `sieve`
+        llong base = 0;
+        /// @brief Memory for offsets of next multiples (`primes->size()` indices), taken by spawning thread from
+        ///     its arena - so that sieving window after window does not allocate it again and again
+        void* next = nullptr;
     };
 
     /**
      * @brief Runnable thread function, that performs sieving on given slice
      *
-     * @param _slice `sieving_strategy::slice*` casted to `void*`
+     * @tparam I type of indices used in marking loops
+     * @tparam S storage policy of sieve
+     * @param _slice `sieving_strategy::slice<S::word>*` casted to `void*`
      * @return `i_op::thread::OS_Runnable_OK`
      */
+    template<typename I, typename S>
     auto thread_calculation(void* _slice)
     {
-        slice slice = *((struct slice*)_slice);
+        auto slice = *((struct slice<typename S::word>*)_slice);
+        llong seg = slice.seg > 0 ? slice.seg : slice.end - slice.begin + 1;
 
-        for (llong i = 2; i <= slice.sqr; i++)
-        {
-            if (slice.sieve->ptr()[i] == num::Prime)
-            {
-                /// smallest multiple of `i` in this slice
-                llong min_factor = ((slice.begin / i) + 1) * i;
+        /* ========================================================================================== */
+        /* Offsets of next multiples are owned by this thread - every prime is applied to one segment */
+        /* (cache-sized, or whole slice) before moving to next, continuing where previous one ended   */
+        /* ========================================================================================== */
+        I* next = (I*)slice.next;
+        first_multiples<I>(slice.begin, *slice.primes, next);
 
-                for (llong j = min_factor; j <= slice.end; j += i)
-                {
-                    slice.sieve->ptr()[j] = num::Composite;
-                }
-            }
+        for (llong lo = slice.begin; lo <= slice.end; lo += seg)
+        {
+            mark_segment<I, S>(slice.sieve->ptr(), (I)slice.base, (I)std::min(lo + seg - 1, slice.end), *slice.primes, next);
         }
 
         return i_op::thread::OS_Runnable_OK;
@@ -142,49 +405,58 @@ namespace sieving_strategy
     /**
      * @brief Performs calculation on `_n` numbers, saving results to `_sieve`.
      *
-     * This functions runs single-threaded for precalculation phase, which is in range 0..sqrt(_n).
+     * This functions runs single-threaded for precalculation phase, which is in range 0..sqrt(_n) - and
+     * collects its primes into list shared by threads (see `base_primes`).
      * Rest of range is divided between threads, which calculate their respective slices concurrently.
-     * Number of spawned threads is equal `_th`, but not more that numbers of CPU cores (_th == -1 is ignored).
+     * Number of spawned threads is equal `_th`, but not more that number of CPUs available to this process
+     * (_th == -1 for all of them) - see `thread_count`.
      *
-     * As slices have minimal, single or few numbers overlap (to counter rounding errors), no synchronization
-     * is used in there - as introducing one would overshadow any time profits from concurrency. 
+     * Slices are produced by `partition` - they cover range exactly, without overlap, and begin on cache line
+     * boundaries, so no two threads ever write the same cache line and no synchronization is needed.
+     *
+     * If `_seg` is positive, threads process their slices in segments of `_seg` numbers, which keeps
+     * written memory in cache while all primes are applied to it.
+     *
+     * @tparam I type of indices - `uint32_t` may be used if `_n < Narrow_Limit`, which halves offsets
+     *      kept by threads and lets compiler vectorize more
+     * @tparam S storage policy of `_sieve` (see `storage`)
      */
-    measure multi_thread(llong _n, util::mem<char>& _sieve, int _th = -1)
+    template<typename I = llong, typename S = storage::byte>
+    measure multi_thread(llong _n, util::mem<typename S::word>& _sieve, int _th = -1, llong _seg = 0)
     {
         /* =============================================================================================== */
         /* Initialization phase - assumes every number is prime (until later it isn't) and marks 1 as root */
         /* =============================================================================================== */
         auto start_i = std::chrono::high_resolution_clock::now();
 
-        for (auto& i : _sieve)
-        {
-            i = num::Prime;
-        }
-        if (1 <= _n) { _sieve.ptr()[1] = num::Root; }
+        S::init(_sieve);
 
         auto end_i = std::chrono::high_resolution_clock::now();
 
 
         /* ===================================================================================================== */
         /* Precalculation phase - performs simple sieving, that skips marking composite numbers. Marking is done */
-        /* up to sqrt(n) on slice that is 10 numbers larger - to counter rounding errors on beginning of         */
-        /* concurrent calculation phase                                                                          */
+        /* up to sqrt(n) - slices of concurrent phase begin right after it                                       */
         /* ===================================================================================================== */
         auto start_sc = std::chrono::high_resolution_clock::now();
 
         llong sqr = std::sqrt(_n);
+        while (sqr * sqr > _n) { sqr--; }
+        while ((sqr + 1) * (sqr + 1) <= _n) { sqr++; }
 
         for (llong i = 2; i <= sqr; i++)
         {
-            if (_sieve.ptr()[i] == num::Prime)
+            if (S::is_prime(_sieve.ptr(), i))
             {
-                for (llong j = i * i; j <= sqr + 10; j += i)
+                for (llong j = i * i; j <= sqr; j += i)
                 {
-                    _sieve.ptr()[j] = num::Composite;
+                    S::mark(_sieve.ptr(), j);
                 }
             }
         }
 
+        auto primes = base_primes<S>(_sieve, sqr);
+
         auto end_sc = std::chrono::high_resolution_clock::now();
 
 
@@ -193,76 +465,357 @@ namespace sieving_strategy
         /* ==================================================================== */
         auto start_mc = std::chrono::high_resolution_clock::now();
 
-        int thread_cnt = _th == -1 ?
-            i_op::process::get_CPU_count() :
-            std::min(_th, (signed)i_op::process::get_CPU_count());
+        auto align = cache_alignment<S>(_sieve.ptr());
+        auto parts = partition(sqr + 1, _n, thread_count(_th), align.first, align.second);
 
 
-        /* ======================================================================== */
-        /* Get size of rest of range - adjusting for at least one number per thread */
-        /* ======================================================================== */
-        llong rest = _n - sqr;
-        if (rest <= thread_cnt)
+        /* ======================================================================================= */
+        /* Allocate threads and their arguments - vector for threads, since no empty constructor   */
+        /* for them exist. Arguments (and offsets of next multiples used by threads) are taken     */
+        /* from arena of this thread, since their address shouldn't change for lifetime of threads */
+        /* ======================================================================================= */
+        util::arena::scope scratch;
+        std::vector<i_op::thread> threads;
+        auto args = scratch.alloc<slice<typename S::word>>(parts.size());
+
+        for (size_t i = 0; i < parts.size(); i++)
         {
-            thread_cnt = 1;
+            args[i] = slice<typename S::word>{
+                parts[i].first,
+                parts[i].second,
+                &_sieve,
+                sqr,
+                _seg,
+                &primes,
+                0,
+                scratch.alloc<I>(primes.size())
+            };
+
+            threads.push_back(i_op::thread{ thread_calculation<I, S>, &args[i] }.start());
         }
 
 
+        /* ======================================================================================= */
+        /* Join all threads - since their work should take roughly the same amount of time and all */
+        /* need to finish, there's no need for more sophisticated joining "algorithm". Memory used */
+        /* by threads is returned to arena once scope ends                                         */
+        /* ======================================================================================= */
+        for (auto th : threads)
+        {
+            th.join();
+        }
+
+        auto end_mc = std::chrono::high_resolution_clock::now();
+
+        /* ================================== */
+        /* Calculate and return time measures */
+        /* ================================== */
+        return measure{
+            (llong)std::chrono::duration_cast<std::chrono::milliseconds>(end_i - start_i).count(),
+            (llong)std::chrono::duration_cast<std::chrono::nanoseconds>(end_i - start_i).count(),
+            (llong)std::chrono::duration_cast<std::chrono::milliseconds>(end_sc - start_sc).count(),
+            (llong)std::chrono::duration_cast<std::chrono::nanoseconds>(end_sc - start_sc).count(),
+            (llong)std::chrono::duration_cast<std::chrono::milliseconds>(end_mc - start_mc).count(),
+            (llong)std::chrono::duration_cast<std::chrono::nanoseconds>(end_mc - start_mc).count(),
+        };
+    }
+
+
+
+    /**
+     * @brief Performs calculation on numbers `_lo`..`_hi` (inclusive) only, saving results to `_sieve`, where
+     * number `j` is kept at index `j - _lo` - so memory holds just the window, not whole range 0.._hi.
+     * For `storage::bit`, `_lo` must be multiple of 64.
+     *
+     * Precalculation phase finds primes up to sqrt(_hi) with `single_thread` on separate, small sieve. Window is
+     * then divided between threads exactly like in `multi_thread`.
+     *
+     * @tparam I type of indices - `uint32_t` may be used if `_hi < Narrow_Limit`
+     * @tparam S storage policy of `_sieve` (see `storage`)
+     */
+    template<typename I = llong, typename S = storage::byte>
+    measure window(llong _lo, llong _hi, util::mem<typename S::word>& _sieve, int _th = -1, llong _seg = 0)
+    {
+        /* =========================================================================== */
+        /* Initialization phase - assumes every number in window is prime, except 0, 1 */
+        /* =========================================================================== */
+        auto start_i = std::chrono::high_resolution_clock::now();
+
+        S::init(_sieve, _lo);
+
+        auto end_i = std::chrono::high_resolution_clock::now();
+
+
+        /* ========================================================= */
+        /* Precalculation phase - sieves primes up to sqrt(hi) aside */
+        /* ========================================================= */
+        auto start_sc = std::chrono::high_resolution_clock::now();
+
+        llong sqr = std::sqrt(_hi);
+        while (sqr * sqr > _hi) { sqr--; }
+        while ((sqr + 1) * (sqr + 1) <= _hi) { sqr++; }
+
         /* ========================================================================= */
-        /* Calculate size of slices - last one will take any remainder from division */
+        /* Scratch of every window comes from arena - reused window after window, in */
+        /* O(1), instead of being allocated each time                                */
         /* ========================================================================= */
-        llong slice_size = rest / thread_cnt;
-        llong last_slice = slice_size * thread_cnt == rest ? slice_size : slice_size + rest % slice_size;
+        util::arena::scope scratch;
+        auto small = util::mem<char>::wrap(scratch.alloc<char>(sqr + 1), sqr + 1);
+        single_thread<llong>(sqr, small);
+        auto primes = base_primes(small, sqr);
+
+        auto end_sc = std::chrono::high_resolution_clock::now();
+
 
+        /* ============================================================= */
+        /* Concurrent calculation phase - divides window between threads */
+        /* ============================================================= */
+        auto start_mc = std::chrono::high_resolution_clock::now();
+
+        auto align = cache_alignment<S>(_sieve.ptr());
+        auto parts = partition(_lo, _hi, thread_count(_th), align.first, ((align.second - _lo) % align.first + align.first) % align.first);
 
-        /* ===================================================================================== */
-        /* Allocate threads and their arguments - vector for threads, since no empty constructor */
-        /* for them exist. Arguments are better suited in allocated memory, since their address  */
-        /* shouldn't change for lifetime of threads                                              */
-        /* ===================================================================================== */
         std::vector<i_op::thread> threads;
-        auto args = util::mem<slice>::calloc(thread_cnt);
+        auto args = scratch.alloc<slice<typename S::word>>(parts.size());
 
-        for (int i = 1; i < thread_cnt; i++)
+        for (size_t i = 0; i < parts.size(); i++)
         {
-
-            /* ============================================================================================= */
-            /* Slices begin after sqrt(n) (without overlap), and overlap each other by 1 number, to counter  */
-            /* any rounding errors in sieving                                                                */
-            /* ============================================================================================= */
-            args.ptr()[i - 1] = slice{
-                sqr + 1 + (i - 1) * slice_size,
-                sqr + 1 + i * slice_size,
+            args[i] = slice<typename S::word>{
+                parts[i].first,
+                parts[i].second,
                 &_sieve,
-                sqr
+                sqr,
+                _seg,
+                &primes,
+                _lo,
+                scratch.alloc<I>(primes.size())
             };
 
-            threads.push_back(i_op::thread{ thread_calculation, &args.ptr()[i - 1] }.start());
+            threads.push_back(i_op::thread{ thread_calculation<I, S>, &args[i] }.start());
         }
 
-        /* ========================================================================== */
-        /* Last range uses own length, to cover last slice until last number in range */
-        /* ========================================================================== */
-        args.ptr()[thread_cnt - 1] = slice{
-            sqr + 1 + (thread_cnt - 1) * slice_size,
-            sqr + 2 + (thread_cnt - 1) * slice_size + last_slice,
-            &_sieve,
-            sqr
+        for (auto th : threads)
+        {
+            th.join();
+        }
+
+        auto end_mc = std::chrono::high_resolution_clock::now();
+
+        /* ================================== */
+        /* Calculate and return time measures */
+        /* ================================== */
+        return measure{
+            (llong)std::chrono::duration_cast<std::chrono::milliseconds>(end_i - start_i).count(),
+            (llong)std::chrono::duration_cast<std::chrono::nanoseconds>(end_i - start_i).count(),
+            (llong)std::chrono::duration_cast<std::chrono::milliseconds>(end_sc - start_sc).count(),
+            (llong)std::chrono::duration_cast<std::chrono::nanoseconds>(end_sc - start_sc).count(),
+            (llong)std::chrono::duration_cast<std::chrono::milliseconds>(end_mc - start_mc).count(),
+            (llong)std::chrono::duration_cast<std::chrono::nanoseconds>(end_mc - start_mc).count(),
         };
+    }
 
-        threads.push_back(i_op::thread{ thread_calculation, &args.ptr()[thread_cnt - 1] }.start());
 
 
+    /**
+     * @brief Fallback size (in numbers) of single segment processed by Sieve of Atkin at once, if size
+     * of L1 data cache is unknown - segments should stay within cache while quadratic forms are toggled
+     */
+    constexpr llong Atkin_Segment = 1 << 15;
+
+    /**
+     * @brief Flips number between prime and composite - Sieve of Atkin marks candidates by parity
+     * of solutions to quadratic forms
+     */
+    inline void atkin_toggle(char& _num)
+    {
+        _num = _num == num::Prime ? num::Composite : num::Prime;
+    }
+
+    /**
+     * @brief Performs Sieve of Atkin on segment `_lo`..`_hi` (exclusive) of `_sieve`.
+     *
+     * Segment must be initialized to `num::Composite` beforehand. Elimination of squares uses `_primes` if
+     * given, otherwise primes from range 5..`_sqr` of `_sieve` - so those must be already calculated if
+     * segment lies above them.
+     */
+    void atkin_segment(llong _lo, llong _hi, char* _sieve, llong _sqr, std::vector<uint32_t> const* _primes = nullptr)
+    {
+        /* =========================================================================================== */
+        /* Toggle candidates that have odd number of solutions to one of three quadratic forms - x and */
+        /* y ranges are narrowed with sqrt, so that every toggle lands inside of segment               */
+        /* =========================================================================================== */
+        for (llong x = 1; 4 * x * x < _hi; x++)
+        {
+            llong xx = 4 * x * x;
+            llong y = xx >= _lo ? 1 : (llong)std::sqrt((double)(_lo - xx));
+            while (y > 1 && xx + (y - 1) * (y - 1) >= _lo) { y--; }
+            while (xx + y * y < _lo) { y++; }
+            for (llong n = xx + y * y; n < _hi; y++, n = xx + y * y)
+            {
+                llong r = n % 12;
+                if (r == 1 || r == 5) { atkin_toggle(_sieve[n]); }
+            }
+        }
+        for (llong x = 1; 3 * x * x < _hi; x++)
+        {
+            llong xx = 3 * x * x;
+            llong y = xx >= _lo ? 1 : (llong)std::sqrt((double)(_lo - xx));
+            while (y > 1 && xx + (y - 1) * (y - 1) >= _lo) { y--; }
+            while (xx + y * y < _lo) { y++; }
+            for (llong n = xx + y * y; n < _hi; y++, n = xx + y * y)
+            {
+                if (n % 12 == 7) { atkin_toggle(_sieve[n]); }
+            }
+        }
+        for (llong x = 2; 2 * x * x + 2 * x - 1 < _hi; x++)
+        {
+            llong xx = 3 * x * x;
+            /// smallest `y` for which result still fits below `_hi` - results decrease as `y` grows
+            llong y = xx - 1 < _hi ? 1 : (llong)std::sqrt((double)(xx - _hi));
+            while (y > 1 && xx - (y - 1) * (y - 1) < _hi) { y--; }
+            while (xx - y * y >= _hi) { y++; }
+            for (llong n = xx - y * y; y < x && n >= _lo; y++, n = xx - y * y)
+            {
+                if (n % 12 == 11) { atkin_toggle(_sieve[n]); }
+            }
+        }
+
         /* ======================================================================================== */
-        /* Join all threads - since their work should take roughly the same amount of time and all  */
-        /* need to finish, there's no need for more sophisticated joining "algorithm". Also free    */
-        /* memory used by threads after they finish                                                 */
+        /* Eliminate multiples of squares of primes - those have even number of factorizations that */
+        /* could toggle them back to composite                                                      */
         /* ======================================================================================== */
+        if (_primes != nullptr)
+        {
+            for (llong p : *_primes)
+            {
+                llong pp = p * p;
+                if (pp >= _hi) { break; }
+                if (p < 5) { continue; }
+
+                for (llong j = std::max(pp, ((_lo + pp - 1) / pp) * pp); j < _hi; j += pp)
+                {
+                    _sieve[j] = num::Composite;
+                }
+            }
+        }
+        else
+        {
+            for (llong p = 5; p <= _sqr; p++)
+            {
+                llong pp = p * p;
+                if (pp >= _hi) { break; }
+                if (_sieve[p] != num::Prime) { continue; }
+
+                for (llong j = std::max(pp, ((_lo + pp - 1) / pp) * pp); j < _hi; j += pp)
+                {
+                    _sieve[j] = num::Composite;
+                }
+            }
+        }
+
+        if (_lo <= 2 && 2 < _hi) { _sieve[2] = num::Prime; }
+        if (_lo <= 3 && 3 < _hi) { _sieve[3] = num::Prime; }
+        if (_lo <= 1 && 1 < _hi) { _sieve[1] = num::Root; }
+    }
+
+    /**
+     * @brief Runnable thread function, that performs Sieve of Atkin on given slice, segment by segment
+     *
+     * @param _slice `sieving_strategy::slice<>*` casted to `void*` - `end` is exclusive here
+     * @return `i_op::thread::OS_Runnable_OK`
+     */
+    auto thread_atkin(void* _slice)
+    {
+        auto slice = *((struct slice<>*)_slice);
+
+        for (llong lo = slice.begin; lo < slice.end; lo += slice.seg)
+        {
+            atkin_segment(lo, std::min(lo + slice.seg, slice.end), slice.sieve->ptr(), slice.sqr, slice.primes);
+        }
+
+        return i_op::thread::OS_Runnable_OK;
+    }
+
+    /**
+     * @brief Performs calculation on `_n` numbers using segmented Sieve of Atkin, saving results to `_sieve`.
+     *
+     * Precalculation phase sieves range 0..sqrt(_n) single-threaded, as its primes are required for
+     * elimination of squares. Rest of range is divided into disjoint slices, which are processed concurrently
+     * in segments sized to L1 data cache. Number of spawned threads follows the same rules as in `multi_thread`.
+     *
+     * As in `multi_thread`, slices do not overlap - every thread writes only to its own part of `_sieve`.
+     */
+    measure atkin(llong _n, util::mem<char>& _sieve, int _th = -1)
+    {
+        /* ================================================================================================= */
+        /* Initialization phase - assumes every number is composite (until odd number of solutions is found) */
+        /* ================================================================================================= */
+        auto start_i = std::chrono::high_resolution_clock::now();
+
+        for (auto& i : _sieve)
+        {
+            i = num::Composite;
+        }
+
+        auto end_i = std::chrono::high_resolution_clock::now();
+
+
+        /* ================================================================================== */
+        /* Precalculation phase - sieves range 0..sqrt(n), which holds primes used by threads */
+        /* ================================================================================== */
+        auto start_sc = std::chrono::high_resolution_clock::now();
+
+        llong sqr = std::sqrt(_n);
+        while (sqr * sqr > _n) { sqr--; }
+        while ((sqr + 1) * (sqr + 1) <= _n) { sqr++; }
+
+        for (llong lo = 0; lo <= sqr; lo += Atkin_Segment)
+        {
+            atkin_segment(lo, std::min(lo + Atkin_Segment, sqr + 1), _sieve.ptr(), sqr);
+        }
+
+        auto primes = base_primes(_sieve, sqr);
+
+        auto end_sc = std::chrono::high_resolution_clock::now();
+
+
+        /* ============================================================================ */
+        /* Concurrent calculation phase - divides rest of range between threads, evenly */
+        /* ============================================================================ */
+        auto start_mc = std::chrono::high_resolution_clock::now();
+
+        llong seg = topology().l1d > 0 ? (llong)topology().l1d : Atkin_Segment;
+
+        /* ================================================================================== */
+        /* Every thread gets at least one segment - slices are aligned to cache lines like in */
+        /* `multi_thread`, `end` is made exclusive as expected by `thread_atkin`              */
+        /* ================================================================================== */
+        int thread_cnt = (int)std::max(1LL, std::min((llong)thread_count(_th), (_n - sqr) / seg));
+        auto align = cache_alignment<storage::byte>(_sieve.ptr());
+        auto parts = partition(sqr + 1, _n, thread_cnt, align.first, align.second);
+
+        util::arena::scope scratch;
+        std::vector<i_op::thread> threads;
+        auto args = scratch.alloc<slice<>>(parts.size());
+
+        for (size_t i = 0; i < parts.size(); i++)
+        {
+            args[i] = slice<>{
+                parts[i].first,
+                parts[i].second + 1,
+                &_sieve,
+                sqr,
+                seg,
+                &primes
+            };
+
+            threads.push_back(i_op::thread{ thread_atkin, &args[i] }.start());
+        }
+
         for (auto th : threads)
         {
             th.join();
         }
-        args.free();
 
         auto end_mc = std::chrono::high_resolution_clock::now();
 
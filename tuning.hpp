@@ -0,0 +1,228 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <climits>
+#include <algorithm>
+
+#include "interoperability/process.hpp"
+#include "util/memory.hpp"
+#include "util/ansi_text.hpp"
+#include "sieving_strategies.hpp"
+
+namespace tuning
+{
+    typedef long long llong;
+
+    /**
+     * @brief Best known configuration of sieving strategies for current host
+     */
+    struct profile
+    {
+        /// @brief Thread count that `multi_thread` should use by default
+        int threads;
+        /// @brief Segment size passed to `multi_thread` (0 for unsegmented slices)
+        llong segment;
+        /// @brief Smallest `n` for which `multi_thread` is faster than `single_thread` - past calibrated range
+        ///     (`Calibration_N + 1`) if it was not faster anywhere in it, since nothing is known about larger `n`
+        llong crossover;
+    };
+
+    /// @brief Upper bound of range used for measuring thread count and segment size grid
+    constexpr llong Calibration_N = 20'000'000;
+    /// @brief Number of repetitions of each measure - best one is taken
+    constexpr int Calibration_Runs = 3;
+
+    /**
+     * @return Path of profile file for current host - placed in home directory, or in working
+     *      directory if none is set
+     */
+    std::string profile_path()
+    {
+#ifdef OS_WIN32
+        char const* home = getenv("USERPROFILE");
+#endif
+#ifdef OS_LINUX
+        char const* home = getenv("HOME");
+#endif
+        std::string dir = home == nullptr ? "." : home;
+        return dir + "/.SO2_L3." + i_op::process::get_host_name() + ".profile";
+    }
+
+    /**
+     * @brief Reads profile of current host
+     *
+     * @param _prof profile to fill
+     * @return `true` if profile exists and contains every value
+     */
+    bool load(profile& _prof)
+    {
+        std::ifstream in(profile_path());
+        if (!in) { return false; }
+
+        int found = 0;
+        std::string line;
+        while (std::getline(in, line))
+        {
+            auto eq = line.find('=');
+            if (eq == std::string::npos) { continue; }
+            auto key = line.substr(0, eq);
+            llong val = std::atoll(line.c_str() + eq + 1);
+
+            if (key == "threads") { _prof.threads = (int)val; found |= 1; }
+            else if (key == "segment") { _prof.segment = val; found |= 2; }
+            else if (key == "crossover") { _prof.crossover = std::min(val, Calibration_N + 1); found |= 4; }
+        }
+
+        return found == 7 && _prof.threads >= 1 && _prof.segment >= 0;
+    }
+
+    /**
+     * @brief Writes profile of current host
+     *
+     * @return `true` if profile was written
+     */
+    bool save(profile const& _prof)
+    {
+        std::ofstream out(profile_path());
+        if (!out) { return false; }
+
+        out << "threads=" << _prof.threads << "\n";
+        out << "segment=" << _prof.segment << "\n";
+        out << "crossover=" << _prof.crossover << "\n";
+        return (bool)out;
+    }
+
+    /**
+     * @return Total time of all phases in `_m`
+     */
+    inline llong total_ns(sieving_strategy::measure const& _m)
+    {
+        return _m.ns_i + _m.ns_sc + _m.ns_mc;
+    }
+
+    /**
+     * @brief Measures Eratosthenes variants on current host, and picks fastest configuration.
+     *
+     * First, `multi_thread` is measured over grid of thread counts (powers of two up to available CPU count) and
+     * segment sizes, on range of `Calibration_N` numbers. Then `single_thread` is compared against the
+     * best of those for growing `n`, to find where spawning threads starts to pay off - if it does not within
+     * `Calibration_N`, threads are still used above it, where they were not measured.
+     *
+     * @param _log stream for progress messages
+     */
+    profile calibrate(std::ostream& _log)
+    {
+        int cpu = (int)i_op::process::get_available_CPU_count();
+        profile best{ cpu, 0, 0 };
+
+        auto sieve = util::mem<char>::calloc(Calibration_N + 1);
+        if (sieve.ptr() == nullptr) { return best; }
+
+        std::vector<int> thread_grid;
+        for (int th = 1; th < cpu; th *= 2) { thread_grid.push_back(th); }
+        thread_grid.push_back(cpu);
+
+        /* ======================================================================================= */
+        /* Segment sizes are taken from cache sizes of host (one byte per number), falling back to */
+        /* typical values if those are unknown                                                     */
+        /* ======================================================================================= */
+        auto const& topo = sieving_strategy::topology();
+        std::vector<llong> segment_grid{ 0 };
+        for (llong seg : {
+            topo.l1d > 0 ? (llong)topo.l1d : 1 << 15,
+            topo.l2 > 0 ? (llong)topo.l2 / 2 : 1 << 17,
+            topo.l2 > 0 ? (llong)topo.l2 : 1 << 19,
+            topo.l3 > 0 ? (llong)(topo.l3 / topo.cores) : 1 << 21 })
+        {
+            if (std::find(segment_grid.begin(), segment_grid.end(), seg) == segment_grid.end())
+            {
+                segment_grid.push_back(seg);
+            }
+        }
+
+        /* ========================================== */
+        /* Pick fastest thread count and segment size */
+        /* ========================================== */
+        _log << ANSI::b_blue << "Calibrating sieve for this host..." << ANSI::reset << "\n";
+        _log
+            << "  " << topo.cores << " cores x " << topo.smt << " SMT, "
+            << topo.numa_nodes << " NUMA node(s), L1d/L2/L3 = "
+            << topo.l1d << "/" << topo.l2 << "/" << topo.l3 << " B, line = " << topo.line << " B\n";
+
+        llong best_ns = LLONG_MAX;
+        for (int th : thread_grid)
+        {
+            for (llong seg : segment_grid)
+            {
+                llong ns = LLONG_MAX;
+                for (int r = 0; r < Calibration_Runs; r++)
+                {
+                    ns = std::min(ns, total_ns(sieving_strategy::multi_thread<uint32_t>(Calibration_N, sieve, th, seg)));
+                }
+                _log << "  threads = " << th << ", segment = " << seg << ": " << ns / 1'000'000 << "ms\n";
+
+                if (ns < best_ns)
+                {
+                    best_ns = ns;
+                    best.threads = th;
+                    best.segment = seg;
+                }
+            }
+        }
+
+        /* ========================================================================= */
+        /* Find smallest order of magnitude of `n` for which threads beat single one */
+        /* ========================================================================= */
+        best.crossover = Calibration_N + 1;
+        for (llong n = 1'000; n <= Calibration_N; n *= 10)
+        {
+            /// view of first `n` numbers, as strategies initialize whole memory they are given
+            auto part = util::mem<char>::wrap(sieve.ptr(), n + 1);
+            llong single_ns = LLONG_MAX;
+            llong multi_ns = LLONG_MAX;
+            for (int r = 0; r < Calibration_Runs; r++)
+            {
+                single_ns = std::min(single_ns, total_ns(sieving_strategy::single_thread<uint32_t>(n, part)));
+                multi_ns = std::min(multi_ns, total_ns(sieving_strategy::multi_thread<uint32_t>(n, part, best.threads, best.segment)));
+            }
+            if (multi_ns < single_ns)
+            {
+                best.crossover = n;
+                break;
+            }
+        }
+
+        _log
+            << ANSI::b_green << "Selected: "
+            << ANSI::reset << "threads = " << best.threads
+            << ", segment = " << best.segment
+            << ", crossover = " << best.crossover << "\n";
+
+        sieve.free();
+        return best;
+    }
+
+    /**
+     * @brief Loads profile of current host, calibrating and saving it if none exists yet
+     *
+     * @param _log stream for progress messages
+     */
+    profile get(std::ostream& _log)
+    {
+        profile prof{};
+        if (load(prof)) { return prof; }
+
+        prof = calibrate(_log);
+        if (!save(prof))
+        {
+            _log
+                << ANSI::b_yellow << "Cannot save profile to " << profile_path()
+                << ANSI::reset << "\n";
+        }
+        return prof;
+    }
+}
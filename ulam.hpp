@@ -3,191 +3,920 @@
 #include <iostream>
 #include <cmath>
 #include <vector>
-#include <fstream>
+#include <algorithm>
+#include <string>
+#include <filesystem>
+#include <climits>
+#include <cstdio>
 
+#include "interoperability/thread.hpp"
 #include "util/memory.hpp"
 #include "util/bmp.hpp"
+#include "util/tiff.hpp"
+#include "interoperability/mapped_file.hpp"
 #include "sieving_strategies.hpp"
 
 namespace ulam
 {
+    typedef long long llong;
+
+    /// @brief Side of square tiles, that image is rendered in - each one is filled by single thread
+    constexpr int Tile = 256;
+
     /**
-     * @brief Maps 2D coordinates to 1D
+     * @brief Calculates number placed at `_x`, `_y` of spiral with 1 at `_cx`, `_cy` - in closed form, so that any
+     *      pixel can be rendered without walking the spiral up to it.
+     *
+     * Spiral starts by moving right, and turns counter-clockwise (towards lower `y` first). Ring `k` (of points
+     * with Chebyshev distance `k` from center) ends with `(2k + 1)^2` at `k`, `k`, and its sides follow each
+     * other starting just above that corner of previous ring.
      */
-    int map(int _x, int _y, int _width)
+    inline llong at(llong _x, llong _y, llong _cx, llong _cy)
     {
-        return _x + _y * _width;
+        llong dx = _x - _cx;
+        llong dy = _y - _cy;
+        llong k = std::max(std::abs(dx), std::abs(dy));
+        llong inner = (2 * k - 1) * (2 * k - 1);
+
+        if (k == 0) { return 1; }
+        if (dx == k && dy < k) { return inner + (k - dy); }
+        if (dy == -k) { return inner + 2 * k + (k - dx); }
+        if (dx == -k) { return inner + 4 * k + (dy + k); }
+        return inner + 6 * k + (dx + k);
     }
 
     /**
-     * @brief Prints Ulam Spiral in simple text format
-     * 
-     * @param _path file path of output
-     * @param _sieve already calculated, sequential memory containing numbers in range 0..n
+     * @return Smallest possible, odd-numbered side length of square that can hold spiral of numbers 1..`_n`
      */
-    void print(char const* _path, util::mem<char>& _sieve)
+    inline llong side_of(llong _n)
     {
-        /* ==================================================================================== */
-        /* Calculate smallest possible, odd-numbered side length of square that can hold spiral */
-        /* ==================================================================================== */
-        int side = std::ceil(std::sqrt(_sieve.len() - 1));
+        llong side = std::ceil(std::sqrt((double)_n));
+        while (side > 0 && (side - 1) * (side - 1) >= _n) { side--; }
+        while (side * side < _n) { side++; }
         side += side % 2 == 0 ? 1 : 0;
+        return side;
+    }
+
+    /// @brief Number of pixels that lie outside of layout - above every range, so that it is shown blank
+    constexpr llong Outside = LLONG_MAX;
+
+    /**
+     * @brief Layout of Ulam Spiral of numbers 1..`n` - square with 1 in center.
+     *
+     * Layouts give number shown by every pixel of `width` x `height` image, by `llong operator ()(x, y)`
+     * (`Outside` if none), so that any part of image can be rendered independently
+     */
+    struct spiral
+    {
+        llong width;
+        llong height;
+
+        explicit spiral(llong _n): width(side_of(_n)), height(width) {}
+
+        llong operator ()(llong _x, llong _y) const { return at(_x, _y, this->width / 2, this->height / 2); }
+    };
+
+    /**
+     * @brief Layout of Klauber triangle of numbers 1..`n` - row `y` (counted from 0 at top) holds numbers
+     *      `y^2 + 1`..`(y + 1)^2`, centered, so that numbers `k^2 + k + c` lie on vertical lines
+     */
+    struct triangle
+    {
+        llong rows;
+        llong width;
+        llong height;
 
-        auto result = util::mem<char>::calloc(side * side);
+        explicit triangle(llong _n)
+        {
+            this->rows = std::sqrt((double)_n);
+            while (this->rows * this->rows < _n) { this->rows++; }
+            while (this->rows > 1 && (this->rows - 1) * (this->rows - 1) >= _n) { this->rows--; }
+            this->width = 2 * this->rows - 1;
+            this->height = this->rows;
+        }
 
+        llong operator ()(llong _x, llong _y) const
         {
-            int x = side / 2;
-            int y = side / 2;
-            int steps_before_turn = 1;
-            bool change_half = false;
-            int direction = 0;
+            llong offset = _x - (this->rows - 1) + _y;
+            if (offset < 0 || offset > 2 * _y) { return Outside; }
+            return _y * _y + 1 + offset;
+        }
+    };
 
-            for (int i = 1; i <= side * side; i++)
+    /**
+     * @brief Tiles of image, painted by single thread
+     *
+     * @tparam P painting function - `void(llong x0, llong y0, llong x1, llong y1)`, that fills pixels of
+     *      rectangle `x0`..`x1`, `y0`..`y1` (both exclusive at end)
+     */
+    template<typename P>
+    struct tile_slice
+    {
+        /// @brief First tile (in row-major order of tiles)
+        llong begin;
+        /// @brief Last tile (inclusive)
+        llong end;
+        llong width;
+        /// @brief Rows `y0`..`y1` (exclusive) are rendered
+        llong y0;
+        llong y1;
+        P const* paint;
+    };
+
+    /**
+     * @brief Runnable thread function, that paints given tiles
+     *
+     * @param _slice `ulam::tile_slice<P>*` casted to `void*`
+     * @return `i_op::thread::OS_Runnable_OK`
+     */
+    template<typename P>
+    auto thread_render(void* _slice)
+    {
+        auto slice = *((tile_slice<P>*)_slice);
+        llong tiles_x = (slice.width + Tile - 1) / Tile;
+
+        for (llong t = slice.begin; t <= slice.end; t++)
+        {
+            llong y0 = slice.y0 + t / tiles_x * Tile;
+            llong x0 = t % tiles_x * Tile;
+            (*slice.paint)(x0, y0, std::min(x0 + Tile, slice.width), std::min(y0 + Tile, slice.y1));
+        }
+
+        return i_op::thread::OS_Runnable_OK;
+    }
+
+    /**
+     * @brief Raster engine - divides rows `_y0`..`_y1` (exclusive) of image `_width` pixels wide into square
+     *      tiles, and paints them with up to `_th` threads (-1 for all available). Tiles are painted
+     *      independently, so that both output rows and sieve ranges touched by single thread stay local
+     *
+     * @param _paint function `void(llong x0, llong y0, llong x1, llong y1)` - see `tile_slice`
+     */
+    template<typename P>
+    void render_tiles(llong _width, llong _y0, llong _y1, P const& _paint, int _th = -1)
+    {
+        llong tiles_x = (_width + Tile - 1) / Tile;
+        llong tiles_y = (_y1 - _y0 + Tile - 1) / Tile;
+        if (tiles_x <= 0 || tiles_y <= 0) { return; }
+        auto parts = sieving_strategy::partition(0, tiles_x * tiles_y - 1, sieving_strategy::thread_count(_th), 1);
+
+        util::arena::scope scratch;
+        std::vector<i_op::thread> threads;
+        auto args = scratch.alloc<tile_slice<P>>(parts.size());
+        for (size_t i = 0; i < parts.size(); i++)
+        {
+            args[i] = tile_slice<P>{ parts[i].first, parts[i].second, _width, _y0, _y1, &_paint };
+            threads.push_back(i_op::thread{ thread_render<P>, &args[i] }.start());
+        }
+        for (auto th : threads)
+        {
+            th.join();
+        }
+    }
+
+    /**
+     * @brief Renders rows `_y0`..`_y1` (exclusive) of `_layout` into `_rows` with up to `_th` threads (-1 for all
+     *      available) - see `render_tiles`
+     *
+     * @param _rows rows of output, indexed by `y - _y0`
+     * @param _shade function `T(llong number)` that gives cell of number
+     */
+    template<typename L, typename T, typename F>
+    void render(L const& _layout, llong _y0, llong _y1, T* const* _rows, F const& _shade, int _th = -1)
+    {
+        render_tiles(_layout.width, _y0, _y1, [&](llong _x0, llong _ty0, llong _x1, llong _ty1)
+        {
+            for (llong y = _ty0; y < _ty1; y++)
             {
-                /* ====================================== */
-                /* Print next byte, or blank if none left */
-                /* ====================================== */
-                if (i <= (signed)_sieve.len())
+                T* row = _rows[y - _y0];
+                for (llong x = _x0; x < _x1; x++)
                 {
-                    result.ptr()[map(x, y, side)] = _sieve.ptr()[i];
+                    row[x] = _shade(_layout(x, y));
                 }
-                else
+            }
+        }, _th);
+    }
+
+    /// @brief Gray levels of image cells - ordered by gray value, so that they index 4-level palette
+    enum level : uint8_t
+    {
+        Prime = 0, Blank = 1, Root = 2, Composite = 3
+    };
+
+    /**
+     * @brief Prints `_layout` in simple text format. Every row takes `width + 1` bytes (with new line), so size of
+     *      file is known upfront - it is mapped into memory, and tiles are rendered by threads straight into it
+     *
+     * @param _level function `ulam::level(llong number)`
+     * @param _th max threads used for rendering (-1 for all available)
+     * @throw i_op::error_msg – if file cannot be created or mapped
+     */
+    template<typename L, typename F>
+    void print_of(char const* _path, L const& _layout, F const& _level, int _th = -1)
+    {
+        llong width = _layout.width;
+        char const symbol[] = { sieving_strategy::num::Prime, ' ', sieving_strategy::num::Root, sieving_strategy::num::Composite };
+
+        /* ====================================================================================== */
+        /* Previous file is removed, so that its pages are not read back - only to be overwritten */
+        /* ====================================================================================== */
+        std::remove(_path);
+        i_op::mapped_file<char> out(_path, (size_t)(_layout.height * (width + 1)));
+        char* text = out.ptr();
+
+        render_tiles(width, 0, _layout.height, [&](llong _x0, llong _y0, llong _x1, llong _y1)
+        {
+            for (llong y = _y0; y < _y1; y++)
+            {
+                char* row = text + y * (width + 1);
+                for (llong x = _x0; x < _x1; x++)
                 {
-                    result.ptr()[map(x, y, side)] = ' ';
+                    row[x] = symbol[_level(_layout(x, y))];
                 }
-                /*=================================================================================== */
-                /* Change direction if necessary - each two changes of direction length before change */
-                /* gets longer by 1                                                                                   */
-                /*=================================================================================== */
-                switch (direction)
+                if (_x1 == width) { row[width] = '\n'; }
+            }
+        }, _th);
+
+        out.close();
+    }
+
+    /**
+     * @brief Saves `_layout` in bmp image format. 8 bit images are mapped into memory and rendered by threads
+     *      straight into file, other depths need rows converted, so they are streamed in bands of tile height -
+     *      and only one band is held in memory at once
+     *
+     * @param _level function `ulam::level(llong number)`
+     * @param _th max threads used for rendering (-1 for all available)
+     * @param _depth bits per pixel - 8 (default) keeps all four gray levels in palette, 1 keeps only primes
+     *      (black) on white background, 24 writes plain RGB
+     * @return `true` if whole image was written
+     * @throw i_op::error_msg – if 8 bit image cannot be created or mapped
+     */
+    template<typename L, typename F>
+    bool picture_of(char const* _path, L const& _layout, F const& _level, int _th = -1, uint16_t _depth = 8)
+    {
+        uint8_t const gray[] = { 0x00, 0x55, 0xaa, 0xff };
+        auto palette = bmp::gray_palette(_depth == 1 ? 2 : 4);
+
+        if (_depth == 8)
+        {
+            bmp::mapped_bitmap img(_path, _layout.width, _layout.height, palette);
+            std::vector<uint8_t*> rows((size_t)_layout.height);
+            for (size_t y = 0; y < rows.size(); y++) { rows[y] = img.pixels().top(y); }
+
+            render(_layout, 0, _layout.height, rows.data(), [&](llong _i) -> uint8_t { return _level(_i); }, _th);
+            img.close();
+            return true;
+        }
+
+        return bmp::stream_bitmap(_path, _layout.width, _layout.height, [&](uint32_t _y, uint32_t _rows, uint8_t* const* _out)
+        {
+            if (_depth == 1)
+            {
+                render(_layout, _y, _y + _rows, _out, [&](llong _i) -> uint8_t { return _level(_i) != Prime; }, _th);
+            }
+            else
+            {
+                render(_layout, _y, _y + _rows, _out, [&](llong _i) { return gray[_level(_i)]; }, _th);
+            }
+        }, _depth, palette, Tile);
+    }
+
+    /**
+     * @brief Saves `_layout` as tiled BigTIFF - raster tiles are the tiles of file, so every thread renders its
+     *      tiles into small buffer and appends them to file as soon as they are done. Neither image, nor its
+     *      band is ever held in memory, and image is not bound by 4 GB limit of bmp
+     *
+     * @param _level function `ulam::level(llong number)`
+     * @param _th max threads used for rendering (-1 for all available)
+     * @param _depth bits per sample - 8 (default) keeps all four gray levels, 1 keeps only primes (black) on
+     *      white background
+     * @return `true` if whole image was written
+     * @throw i_op::error_msg – if file cannot be created
+     */
+    template<typename L, typename F>
+    bool tiff_of(char const* _path, L const& _layout, F const& _level, int _th = -1, uint16_t _depth = 8)
+    {
+        static_assert(tiff::Tile_Side == Tile, "raster tiles must match tiles of file");
+        uint8_t const gray[] = { 0x00, 0x55, 0xaa, 0xff };
+
+        tiff::writer out(_path, _layout.width, _layout.height, _depth == 1 ? 1 : 8);
+        render_tiles(_layout.width, 0, _layout.height, [&](llong _x0, llong _y0, llong _x1, llong _y1)
+        {
+            util::arena::scope scratch;
+            uint8_t* tile = scratch.calloc<uint8_t>((size_t)Tile * Tile);
+            for (llong y = _y0; y < _y1; y++)
+            {
+                uint8_t* row = tile + (y - _y0) * Tile;
+                for (llong x = _x0; x < _x1; x++)
+                {
+                    uint8_t shade = _level(_layout(x, y));
+                    row[x - _x0] = _depth == 1 ? shade != Prime : gray[shade];
+                }
+            }
+            out.pack(tile);
+            out.put((uint32_t)(_x0 / Tile), (uint32_t)(_y0 / Tile), tile);
+        }, _th);
+        return out.finish();
+    }
+
+    /**
+     * @brief Sacks spiral of numbers 1..`n` - number `i` lies at radius `sqrt(i)` and angle `2 pi sqrt(i)`, so
+     *      that squares lie on horizontal line right of 0, and every turn holds next `2k + 1` numbers. Radius
+     *      of whole spiral is scaled to half of `side_of(n)`, so that image has the same size as Ulam Spiral
+     */
+    struct sacks
+    {
+        llong n;
+        llong width;
+        llong height;
+        /// @brief Pixels per unit of radius
+        double scale;
+
+        explicit sacks(llong _n):
+            n(_n), width(side_of(_n)), height(width), scale((double)(width / 2) / std::sqrt((double)std::max(_n, 1LL)))
+        {}
+
+        /**
+         * @brief Paints pixels `_x0`..`_x1`, `_y0`..`_y1` (exclusive) into `_rows` (indexed by `y - _band`), as
+         *      coverage of primes - each prime is splatted on 4 nearest pixels with bilinear weights. White
+         *      means no prime, black - at least one prime fully covering pixel.
+         *
+         * Numbers are not searched one by one - point at angle `phi` lies on spiral only where fraction of
+         * radius is `phi / 2 pi`, so within angular bounds of tile (extended by one pixel, that splats reach
+         * from) radii form one interval per turn, and each one holds contiguous range of numbers
+         *
+         * @param _level function `ulam::level(llong number)`
+         */
+        template<typename F>
+        void paint(llong _x0, llong _y0, llong _x1, llong _y1, llong _band, uint8_t* const* _rows, F const& _level) const
+        {
+            constexpr double Turn = 2 * 3.14159265358979323846;
+            double c = (double)(this->width / 2);
+            util::arena::scope scratch;
+            float* acc = scratch.calloc<float>((size_t)((_x1 - _x0) * (_y1 - _y0)));
+
+            /* =================================================================================== */
+            /* Bounds of tile extended by one pixel, in units of radius (with `y` pointing upward) */
+            /* =================================================================================== */
+            double ux[2] = { (_x0 - 1 - c) / this->scale, (_x1 - c) / this->scale };
+            double uy[2] = { (c - _y1) / this->scale, (c - _y0 + 1) / this->scale };
+            double r_min = std::hypot(std::min(std::max(0.0, ux[0]), ux[1]), std::min(std::max(0.0, uy[0]), uy[1]));
+            double r_max = 0;
+            for (int i = 0; i < 4; i++) { r_max = std::max(r_max, std::hypot(ux[i % 2], uy[i / 2])); }
+
+            /* ========================================================================================= */
+            /* Fractions of turn covered by tile - whole turn, if tile holds center, less than half else */
+            /* ========================================================================================= */
+            double a = 0;
+            double b = 1;
+            if (r_min > 0)
+            {
+                double mid = std::atan2((uy[0] + uy[1]) / 2, (ux[0] + ux[1]) / 2);
+                double lo = 0;
+                double hi = 0;
+                for (int i = 0; i < 4; i++)
                 {
-                case 0:
-                    x++;
-                    break;
-                case 1:
-                    y--;
-                    break;
-                case 2:
-                    x--;
-                    break;
-                case 3:
-                    y++;
-                    break;
+                    double d = std::remainder(std::atan2(uy[i / 2], ux[i % 2]) - mid, Turn);
+                    lo = std::min(lo, d);
+                    hi = std::max(hi, d);
                 }
-                if (i % steps_before_turn == 0)
+                a = (mid + lo) / Turn;
+                b = (mid + hi) / Turn;
+            }
+
+            auto splat = [&](llong _x, llong _y, double _w)
+            {
+                if (_x < _x0 || _x >= _x1 || _y < _y0 || _y >= _y1) { return; }
+                acc[(_y - _y0) * (_x1 - _x0) + (_x - _x0)] += (float)_w;
+            };
+            for (llong m = (llong)std::floor(r_min - b); m + a <= r_max; m++)
+            {
+                double r_lo = std::max({ m + a, r_min, 0.0 });
+                double r_hi = std::min(m + b, r_max);
+                if (r_lo > r_hi) { continue; }
+
+                llong from = std::max(1LL, (llong)std::floor(r_lo * r_lo));
+                llong to = std::min(this->n, (llong)std::ceil(r_hi * r_hi));
+                for (llong i = from; i <= to; i++)
                 {
-                    direction = (direction + 1) % 4;
-                    change_half = !change_half;
-                    if (change_half)
-                    {
-                        steps_before_turn++;
-                    }
+                    if (_level(i) != Prime) { continue; }
+                    double r = std::sqrt((double)i);
+                    double x = c + this->scale * r * std::cos(Turn * r);
+                    double y = c - this->scale * r * std::sin(Turn * r);
+                    llong fx = (llong)std::floor(x);
+                    llong fy = (llong)std::floor(y);
+                    double wx = x - fx;
+                    double wy = y - fy;
+                    splat(fx, fy, (1 - wx) * (1 - wy));
+                    splat(fx + 1, fy, wx * (1 - wy));
+                    splat(fx, fy + 1, (1 - wx) * wy);
+                    splat(fx + 1, fy + 1, wx * wy);
                 }
             }
-        }
 
-        /* ============= */
-        /* Print to file */
-        /* ============= */
-        std::fstream out(_path, out.out);
-        for (int y = 0; y < side; y++)
-        {
-            for (int x = 0; x < side; x++)
+            for (llong y = _y0; y < _y1; y++)
             {
-                out << result.ptr()[map(x, y, side)];
+                uint8_t* row = _rows[y - _band];
+                for (llong x = _x0; x < _x1; x++)
+                {
+                    float cover = std::min(1.0f, acc[(y - _y0) * (_x1 - _x0) + (x - _x0)]);
+                    row[x] = (uint8_t)(255 - (int)(cover * 255 + 0.5f));
+                }
             }
-            out << "\n";
         }
-
-        result.free();
-    }
+    };
 
     /**
-     * @brief Saves Ulam Spiral in bmp image format
+     * @brief Saves Sacks spiral of numbers 1..`_n` in bmp image format, anti-aliased - painted tile by tile in
+     *      parallel, straight into mapped file for 8 bit image, or in streamed bands of tile height otherwise
      *
-     * @param _path file path of output
-     * @param _sieve already calculated, sequential memory containing numbers in range 0..n
+     * @param _level function `ulam::level(llong number)`
+     * @param _th max threads used for rendering (-1 for all available)
+     * @param _depth bits per pixel - 8 (default) for 256 gray levels, 1 for primes (black) where coverage
+     *      exceeds half of pixel, 24 for plain RGB
+     * @return `true` if whole image was written
+     * @throw i_op::error_msg – if 8 bit image cannot be created or mapped
      */
-    void picture(char const* _path, util::mem<char>& _sieve)
+    template<typename F>
+    bool sacks_of(char const* _path, llong _n, F const& _level, int _th = -1, uint16_t _depth = 8)
     {
-        /* ==================================================================================== */
-        /* Calculate smallest possible, odd-numbered side length of square that can hold spiral */
-        /* ==================================================================================== */
-        int side = std::ceil(std::sqrt(_sieve.len() - 1));
-        side += side % 2 == 0 ? 1 : 0;
+        sacks layout(_n);
+        auto palette = bmp::gray_palette(_depth == 1 ? 2 : 256);
 
-        std::vector<std::vector<uint8_t>> result{ (size_t)side };
-        for (auto& row : result)
+        if (_depth == 8)
         {
-            row = std::vector<uint8_t>((size_t)side);
+            bmp::mapped_bitmap img(_path, layout.width, layout.height, palette);
+            std::vector<uint8_t*> rows((size_t)layout.height);
+            for (size_t y = 0; y < rows.size(); y++) { rows[y] = img.pixels().top(y); }
+
+            render_tiles(layout.width, 0, layout.height, [&](llong _x0, llong _y0, llong _x1, llong _y1)
+            {
+                layout.paint(_x0, _y0, _x1, _y1, 0, rows.data(), _level);
+            }, _th);
+            img.close();
+            return true;
         }
 
+        return bmp::stream_bitmap(_path, layout.width, layout.height, [&](uint32_t _y, uint32_t _rows, uint8_t* const* _out)
         {
-            int x = side / 2;
-            int y = side / 2;
-            int steps_before_turn = 1;
-            bool change_half = false;
-            int direction = 0;
-
-            for (int i = 1; i <= side * side; i++)
+            render_tiles(layout.width, _y, _y + _rows, [&](llong _x0, llong _y0, llong _x1, llong _y1)
             {
-                /* ======================================= */
-                /* Print next pixel, or blank if none left */
-                /* ======================================= */
-                if (i <= (signed)_sieve.len())
+                layout.paint(_x0, _y0, _x1, _y1, _y, _out, _level);
+                if (_depth != 1) { return; }
+                for (llong y = _y0; y < _y1; y++)
                 {
-                    switch (_sieve.ptr()[i])
+                    for (llong x = _x0; x < _x1; x++)
                     {
-                    case sieving_strategy::num::Root:
-                        result[y][x] = 0xaa;
-                        break;
-                    case sieving_strategy::num::Prime:
-                        result[y][x] = 0x00;
-                        break;
-                    case sieving_strategy::num::Composite:
-                        result[y][x] = 0xff;
-                        break;
+                        _out[y - _y][x] = _out[y - _y][x] >= 0x80;
                     }
                 }
-                else
+            }, _th);
+        }, _depth, palette, Tile);
+    }
+
+    /**
+     * @brief Gives level of numbers in `char` sieve (see `sieving_strategy::num`) of numbers 0..`_len - 1`
+     */
+    struct char_levels
+    {
+        char const* sieve;
+        llong len;
+
+        level operator ()(llong _i) const
+        {
+            if (_i >= this->len) { return Blank; }
+            switch (this->sieve[_i])
+            {
+            case sieving_strategy::num::Root:
+                return Root;
+            case sieving_strategy::num::Prime:
+                return Prime;
+            default:
+                return Composite;
+            }
+        }
+    };
+
+    /**
+     * @brief Gives level of numbers in bit sieve (see `sieving_strategy::storage::bit`) of numbers 0..`n`
+     */
+    struct bit_levels
+    {
+        uint64_t const* sieve;
+        llong n;
+
+        level operator ()(llong _i) const
+        {
+            if (_i > this->n) { return Blank; }
+            if (_i == 1) { return Root; }
+            return sieving_strategy::storage::bit::is_prime(this->sieve, _i) ? Prime : Composite;
+        }
+    };
+
+    /**
+     * @brief Rows of heatmap, rendered by single thread
+     */
+    struct heat_slice
+    {
+        /// @brief First row of pixels (counted from top of image)
+        llong begin;
+        /// @brief Last row of pixels (inclusive)
+        llong end;
+        llong n;
+        llong side;
+        /// @brief Side of square block of spiral cells, that is shown by single pixel
+        llong block;
+        /// @brief Bit sieve of numbers 0..`n` (see `sieving_strategy::storage::bit`)
+        uint64_t const* sieve;
+        bmp::view<bmp::pixel_t> img;
+    };
+
+    /**
+     * @brief Runnable thread function, that renders given rows of heatmap.
+     *
+     * Numbers of block are not contiguous, but part of every cell row where `|dy| >= |dx|` lies on horizontal
+     * side of single ring, and so does part of every cell column where `|dx| > |dy|` on vertical one - so block
+     * is covered by runs of consecutive numbers, and primes in each of them are counted by popcount of sieve
+     * words. Pixel shows count of primes relative to count expected by prime number theorem (numbers of block
+     * divided by logarithm of their mean), so that diagonals stand out equally far from center
+     *
+     * @param _slice `ulam::heat_slice*` casted to `void*`
+     * @return `i_op::thread::OS_Runnable_OK`
+     */
+    auto thread_heat(void* _slice)
+    {
+        auto slice = *((heat_slice*)_slice);
+        llong center = slice.side / 2;
+        llong width = (slice.side + slice.block - 1) / slice.block;
+        std::vector<llong> primes(width);
+        std::vector<llong> numbers(width);
+        std::vector<double> sum(width);
+
+        auto run = [&](llong _px, llong _a, llong _b)
+        {
+            llong lo = std::min(_a, _b);
+            llong hi = std::min(std::max(_a, _b), slice.n);
+            if (lo > hi) { return; }
+            primes[_px] += sieving_strategy::storage::bit::count(slice.sieve, lo, hi);
+            numbers[_px] += hi - lo + 1;
+            sum[_px] += (double)(lo + hi) / 2 * (hi - lo + 1);
+        };
+
+        for (llong py = slice.begin; py <= slice.end; py++)
+        {
+            std::fill(primes.begin(), primes.end(), 0);
+            std::fill(numbers.begin(), numbers.end(), 0);
+            std::fill(sum.begin(), sum.end(), 0.0);
+
+            llong y0 = py * slice.block;
+            llong y1 = std::min(y0 + slice.block, slice.side);
+            for (llong y = y0; y < y1; y++)
+            {
+                llong k = std::abs(y - center);
+                for (llong x = center - k; x <= center + k;)
                 {
-                    result[y][x] = (uint8_t)0x55;
+                    llong px = x / slice.block;
+                    llong to = std::min(center + k, (px + 1) * slice.block - 1);
+                    run(px, at(x, y, center, center), at(to, y, center, center));
+                    x = to + 1;
                 }
-                /*=================================================================================== */
-                /* Change direction if necessary - each two changes of direction length before change */
-                /* gets longer by 1                                                                                   */
-                /*=================================================================================== */
-                switch (direction)
+            }
+            for (llong x = 0; x < slice.side; x++)
+            {
+                llong k = std::abs(x - center);
+                llong from = std::max(y0, center - k + 1);
+                llong to = std::min(y1 - 1, center + k - 1);
+                if (from > to) { continue; }
+                run(x / slice.block, at(x, from, center, center), at(x, to, center, center));
+            }
+
+            bmp::pixel_t* row = slice.img.top(py);
+            for (llong px = 0; px < width; px++)
+            {
+                if (numbers[px] == 0)
                 {
-                case 0:
-                    x++;
-                    break;
-                case 1:
-                    y--;
-                    break;
-                case 2:
-                    x--;
-                    break;
-                case 3:
-                    y++;
-                    break;
+                    row[px] = bmp::pixel_t{ 0x55, 0x55, 0x55 };
+                    continue;
                 }
-                if (i % steps_before_turn == 0)
+                double mean = sum[px] / numbers[px];
+                double expected = mean > 3 ? numbers[px] / std::log(mean) : numbers[px];
+                row[px] = bmp::color_ramp(primes[px] / expected / 2);
+            }
+        }
+
+        return i_op::thread::OS_Runnable_OK;
+    }
+
+    /**
+     * @brief Saves prime density heatmap of Ulam Spiral of numbers 1..`_n` in bmp image format - spiral is
+     *      divided into square blocks, each shown by single pixel, so that image is at most `_max_side` pixels
+     *      wide regardless of `_n`. Density relative to expected one is shown on `bmp::color_ramp`, where middle
+     *      of ramp means as many primes as expected. Cells past `_n` are gray
+     *
+     * @param _sieve bit sieve of numbers 0..`_n` (see `sieving_strategy::storage::bit`)
+     * @param _th max threads used for rendering (-1 for all available)
+     * @return Side of block of cells, that is shown by single pixel (-1 if image cannot be written)
+     * @throw std::bad_alloc – if memory for image cannot be allocated
+     */
+    llong heatmap(char const* _path, llong _n, uint64_t const* _sieve, llong _max_side, int _th = -1)
+    {
+        llong side = side_of(_n);
+        llong block = (side + _max_side - 1) / _max_side;
+        llong width = (side + block - 1) / block;
+
+        bmp::image<bmp::pixel_t> img(width, width);
+        auto parts = sieving_strategy::partition(0, width - 1, sieving_strategy::thread_count(_th), 1);
+
+        util::arena::scope scratch;
+        std::vector<i_op::thread> threads;
+        auto args = scratch.alloc<heat_slice>(parts.size());
+        for (size_t i = 0; i < parts.size(); i++)
+        {
+            args[i] = heat_slice{ parts[i].first, parts[i].second, _n, side, block, _sieve, img };
+            threads.push_back(i_op::thread{ thread_heat, &args[i] }.start());
+        }
+        for (auto th : threads)
+        {
+            th.join();
+        }
+
+        return bmp::save_bitmap_rgb(img, _path) ? block : -1;
+    }
+
+    /// @brief Count of pixels in single tile of pyramid
+    constexpr llong Tile_Px = (llong)Tile * Tile;
+
+    /**
+     * @brief Multi-resolution tile pyramid of spiral - level `levels - 1` holds spiral in full resolution, and
+     *      every level above is downsampled 2 times, up to level 0 that fits in single tile
+     */
+    struct pyramid_layout
+    {
+        llong n;
+        llong side;
+        int levels;
+        /// @brief Base primes up to sqrt(n)
+        std::vector<uint32_t> const* primes;
+        /// @brief Output directory, holding `<level>/<x>_<y>.bmp` tiles
+        std::string dir;
+
+        /// @return Count of full resolution pixels covered by side of tile at `_level`
+        llong span(int _level) const { return (llong)Tile << (this->levels - 1 - _level); }
+
+        /// @return Whether tile `_tx`, `_ty` at `_level` covers any part of spiral
+        bool inside(int _level, llong _tx, llong _ty) const
+        {
+            return _tx * this->span(_level) < this->side && _ty * this->span(_level) < this->side;
+        }
+    };
+
+    /**
+     * @brief Renders tile `_tx`, `_ty` of full resolution level into `_img` (gray levels, top row first), sieving
+     *      only numbers shown in it. Part of every row, where `|dy| >= |dx|`, lies on horizontal side of single
+     *      ring, and so does part of every column where `|dx| > |dy|` on vertical one - both hold contiguous range
+     *      of numbers, that is sieved on its own
+     */
+    void pyramid_leaf(pyramid_layout const& _lay, llong _tx, llong _ty, uint8_t* _img)
+    {
+        uint8_t const gray[] = { 0x00, 0x55, 0xaa, 0xff };
+        llong center = _lay.side / 2;
+        llong x0 = _tx * Tile;
+        llong y0 = _ty * Tile;
+        std::fill(_img, _img + Tile_Px, gray[Blank]);
+
+        /* =============================================================================================== */
+        /* Sieves `_cnt` consecutive numbers that start at `_first` and go by `_step` (1 or -1), and fills */
+        /* pixels starting at `_px`, `_py`, going by `_dx`, `_dy`                                          */
+        /* =============================================================================================== */
+        util::arena::scope scratch;
+        auto buf = util::mem<char>::wrap(scratch.alloc<char>(Tile), Tile);
+        auto run = [&](llong _first, llong _step, llong _cnt, llong _px, llong _py, int _dx, int _dy)
+        {
+            llong lo = _step > 0 ? _first : _first - (_cnt - 1);
+            llong hi = std::min(lo + _cnt - 1, _lay.n);
+            if (lo > hi) { return; }
+
+            auto range = util::mem<char>::wrap(buf.ptr(), hi - lo + 1);
+            sieving_strategy::sieve_range(lo, hi, range, *_lay.primes);
+
+            for (llong i = 0; i < _cnt; i++)
+            {
+                llong v = _first + _step * i;
+                if (v > hi) { continue; }
+                char c = buf.ptr()[v - lo];
+                _img[(_py + _dy * i - y0) * Tile + (_px + _dx * i - x0)] = gray[
+                    c == sieving_strategy::num::Root ? Root :
+                    c == sieving_strategy::num::Prime ? Prime : Composite];
+            }
+        };
+
+        llong x_end = std::min(x0 + Tile, _lay.side);
+        llong y_end = std::min(y0 + Tile, _lay.side);
+        for (llong y = y0; y < y_end; y++)
+        {
+            llong k = std::abs(y - center);
+            llong from = std::max(x0, center - k);
+            llong to = std::min(x_end - 1, center + k);
+            if (from > to) { continue; }
+            llong first = at(from, y, center, center);
+            llong step = from < to ? at(from + 1, y, center, center) - first : 1;
+            run(first, step, to - from + 1, from, y, 1, 0);
+        }
+        for (llong x = x0; x < x_end; x++)
+        {
+            llong k = std::abs(x - center);
+            llong from = std::max(y0, center - k + 1);
+            llong to = std::min(y_end - 1, center + k - 1);
+            if (from > to) { continue; }
+            llong first = at(x, from, center, center);
+            llong step = from < to ? at(x, from + 1, center, center) - first : 1;
+            run(first, step, to - from + 1, x, from, 0, 1);
+        }
+    }
+
+    /**
+     * @brief Saves tile `_tx`, `_ty` of `_level` as 8 bit gray bmp
+     *
+     * @return `true` if whole tile was written
+     */
+    bool pyramid_save(pyramid_layout const& _lay, int _level, llong _tx, llong _ty, uint8_t const* _img)
+    {
+        std::string path = _lay.dir + "/" + std::to_string(_level) + "/" + std::to_string(_tx) + "_" + std::to_string(_ty) + ".bmp";
+        bmp::writer out(path.c_str(), Tile, Tile, 8, bmp::gray_palette(256));
+        for (int y = Tile; y-- > 0;)
+        {
+            out.row(_img + y * Tile);
+        }
+        return out.finish();
+    }
+
+    /**
+     * @brief Downsamples 4 tiles (in order top-left, top-right, bottom-left, bottom-right) 2 times into `_img`
+     */
+    void pyramid_merge(uint8_t const* const* _children, uint8_t* _img)
+    {
+        for (int y = 0; y < Tile; y++)
+        {
+            for (int x = 0; x < Tile; x++)
+            {
+                uint8_t const* child = _children[(y / (Tile / 2)) * 2 + x / (Tile / 2)];
+                int cx = (x % (Tile / 2)) * 2;
+                int cy = (y % (Tile / 2)) * 2;
+                int sum = child[cy * Tile + cx] + child[cy * Tile + cx + 1] + child[(cy + 1) * Tile + cx] + child[(cy + 1) * Tile + cx + 1];
+                _img[y * Tile + x] = (uint8_t)((sum + 2) / 4);
+            }
+        }
+    }
+
+    /**
+     * @brief Renders tile `_tx`, `_ty` of `_level` into `_img`, together with every tile below it - depth first,
+     *      so that only 4 tiles per level are held in memory (on arena of rendering thread, taken and given back
+     *      in stack order). Tiles outside of spiral are left blank, and not saved
+     *
+     * @return `true` if every tile of subtree was written - rendering stops at first failed one
+     */
+    bool pyramid_subtree(pyramid_layout const& _lay, int _level, llong _tx, llong _ty, uint8_t* _img)
+    {
+        if (!_lay.inside(_level, _tx, _ty))
+        {
+            std::fill(_img, _img + Tile_Px, (uint8_t)0x55);
+            return true;
+        }
+
+        if (_level == _lay.levels - 1)
+        {
+            pyramid_leaf(_lay, _tx, _ty, _img);
+        }
+        else
+        {
+            util::arena::scope scratch;
+            uint8_t* children = scratch.alloc<uint8_t>(4 * Tile_Px);
+            uint8_t const* quads[4];
+            for (int c = 0; c < 4; c++)
+            {
+                if (!pyramid_subtree(_lay, _level + 1, _tx * 2 + c % 2, _ty * 2 + c / 2, children + c * Tile_Px)) { return false; }
+                quads[c] = children + c * Tile_Px;
+            }
+            pyramid_merge(quads, _img);
+        }
+        return pyramid_save(_lay, _level, _tx, _ty, _img);
+    }
+
+    /**
+     * @brief Subtrees of pyramid, rendered by single thread
+     */
+    struct pyramid_slice
+    {
+        /// @brief First subtree (in row-major order of tiles at `level`)
+        llong begin;
+        /// @brief Last subtree (inclusive)
+        llong end;
+        int level;
+        pyramid_layout const* layout;
+        /// @brief Images of every tile at `level`
+        uint8_t* images;
+        /// @brief Whether every tile of subtrees was written (output)
+        bool ok;
+    };
+
+    /**
+     * @brief Runnable thread function, that renders given subtrees of pyramid
+     *
+     * @param _slice `ulam::pyramid_slice*` casted to `void*`
+     * @return `i_op::thread::OS_Runnable_OK`
+     */
+    auto thread_pyramid(void* _slice)
+    {
+        auto slice = (pyramid_slice*)_slice;
+        llong tiles = 1LL << slice->level;
+        for (llong t = slice->begin; t <= slice->end && slice->ok; t++)
+        {
+            slice->ok = pyramid_subtree(*slice->layout, slice->level, t % tiles, t / tiles, slice->images + t * Tile_Px);
+        }
+        return i_op::thread::OS_Runnable_OK;
+    }
+
+    /**
+     * @brief Saves Ulam Spiral of numbers 1..`_n` as tile pyramid into `_dir` - `<level>/<x>_<y>.bmp` files of
+     *      8 bit gray `Tile` x `Tile` images, where level 0 fits whole spiral in one tile, and each following
+     *      one doubles resolution, up to one pixel per number.
+     *
+     * Full resolution tiles are rendered independently, each sieving only numbers it shows. Tiles above are
+     * downsampled from 4 tiles below them. Work is divided between up to `_th` threads (-1 for all available)
+     * as whole subtrees, that are rendered depth first - so memory use stays small regardless of `_n`.
+     *
+     * @return Count of levels (-1 if any directory or tile cannot be written)
+     */
+    int pyramid(char const* _dir, llong _n, int _th = -1)
+    {
+        llong side = side_of(_n);
+        int levels = 1;
+        while (((llong)Tile << (levels - 1)) < side) { levels++; }
+
+        llong sqr = std::sqrt((double)_n);
+        while (sqr * sqr > _n) { sqr--; }
+        while ((sqr + 1) * (sqr + 1) <= _n) { sqr++; }
+        util::arena::scope scratch;
+        auto small = util::mem<char>::wrap(scratch.alloc<char>(sqr + 1), sqr + 1);
+        sieving_strategy::single_thread<llong>(sqr, small);
+        auto primes = sieving_strategy::base_primes(small, sqr);
+
+        pyramid_layout lay{ _n, side, levels, &primes, _dir };
+        for (int l = 0; l < levels; l++)
+        {
+            std::error_code err;
+            std::filesystem::create_directories(lay.dir + "/" + std::to_string(l), err);
+            if (err) { return -1; }
+        }
+
+        /* ================================================================================================ */
+        /* Threads get subtrees rooted at level deep enough to give each of them several - tiles above that */
+        /* are merged afterwards from kept images of that level                                             */
+        /* ================================================================================================ */
+        int thread_cnt = sieving_strategy::thread_count(_th);
+        int level = 0;
+        while (level < levels - 1 && (1LL << (2 * level)) < 4LL * thread_cnt) { level++; }
+
+        llong tiles = 1LL << level;
+        std::vector<uint8_t> images((size_t)(tiles * tiles * Tile_Px));
+        auto parts = sieving_strategy::partition(0, tiles * tiles - 1, thread_cnt, 1);
+
+        std::vector<i_op::thread> threads;
+        auto args = scratch.alloc<pyramid_slice>(parts.size());
+        for (size_t i = 0; i < parts.size(); i++)
+        {
+            args[i] = pyramid_slice{ parts[i].first, parts[i].second, level, &lay, images.data(), true };
+            threads.push_back(i_op::thread{ thread_pyramid, &args[i] }.start());
+        }
+        bool ok = true;
+        for (size_t i = 0; i < threads.size(); i++)
+        {
+            threads[i].join();
+            ok = ok && args[i].ok;
+        }
+        if (!ok) { return -1; }
+
+        for (; level > 0; level--, tiles /= 2)
+        {
+            std::vector<uint8_t> above((size_t)(tiles / 2 * tiles / 2 * Tile_Px));
+            for (llong ty = 0; ty < tiles / 2; ty++)
+            {
+                for (llong tx = 0; tx < tiles / 2; tx++)
                 {
-                    direction = (direction + 1) % 4;
-                    change_half = !change_half;
-                    if (change_half)
+                    uint8_t* img = above.data() + (ty * tiles / 2 + tx) * Tile_Px;
+                    uint8_t const* quads[4];
+                    for (int c = 0; c < 4; c++)
                     {
-                        steps_before_turn++;
+                        quads[c] = images.data() + ((ty * 2 + c / 2) * tiles + tx * 2 + c % 2) * Tile_Px;
                     }
+                    pyramid_merge(quads, img);
+                    if (lay.inside(level - 1, tx, ty) && !pyramid_save(lay, level - 1, tx, ty, img)) { return -1; }
                 }
             }
+            images.swap(above);
         }
 
-        /* ============== */
-        /* Print to image */
-        /* ============== */
-        std::reverse(result.begin(), result.end());
-        bmp::save_bitmap_mono(result, _path);
+        return levels;
     }
 }
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <new>
+
+#include "../interoperability/async_file.hpp"
+
+/* ============================================================================================ */
+/* Sequential file output, that overlaps producing data with writing it - bytes are gathered in */
+/* one of few large, page-aligned buffers, and every full buffer is handed to OS asynchronously */
+/* (`i_op::async_file`), while next one is being filled. Buffer is reused only after its write  */
+/* is done, so at most `Write_Depth - 1` buffers wait for disk, while producer keeps going      */
+/* ============================================================================================ */
+namespace util
+{
+    /// @brief Alignment of write buffers (and their sizes)
+    constexpr size_t Write_Align = 4096;
+    /// @brief Default size of single write buffer
+    constexpr size_t Write_Buffer = 4 << 20;
+    /// @brief Count of write buffers - one is filled, while others are written
+    constexpr unsigned Write_Depth = 3;
+
+    /// @brief `false` makes writers skip io_uring and use thread pool of `i_op::async_file` instead
+    inline bool use_ring = true;
+
+    /**
+     * @brief Buffered, asynchronous writer of single file. Any write failure (including failure to create
+     *      file) is remembered, and reported by `good` and `finish` - later writes are silently dropped then
+     */
+    class async_writer
+    {
+    private:
+        i_op::async_file* __file = nullptr;
+        void* __block = nullptr;
+        uint8_t* __bufs = nullptr;
+        size_t __size;
+        unsigned __depth;
+        /// @brief Buffer being filled
+        unsigned __cur = 0;
+        /// @brief Bytes filled in current buffer
+        size_t __fill = 0;
+        /// @brief File offset of first byte of current buffer
+        uint64_t __offset = 0;
+        bool __good = false;
+
+        async_writer(async_writer const&) = delete;
+
+        uint8_t* buffer(unsigned _i) { return this->__bufs + _i * this->__size; }
+
+        /**
+         * @brief Hands current buffer to OS, and moves to next one - waiting until its previous write is done
+         *
+         * @param _last `true` if no more data follows, so that buffer is written right away
+         */
+        void submit(bool _last = false)
+        {
+            if (this->__fill == 0) { return; }
+            if (this->__file == nullptr)
+            {
+                this->__fill = 0;
+                return;
+            }
+            try
+            {
+                if (_last && this->__offset == 0)
+                {
+                    /* ============================================================= */
+                    /* Whole file fits in one buffer - nothing to overlap write with */
+                    /* ============================================================= */
+                    this->__file->write_now(this->buffer(this->__cur), this->__fill, this->__offset);
+                }
+                else
+                {
+                    this->__file->write(this->__cur, this->buffer(this->__cur), this->__fill, this->__offset);
+                    this->__cur = (this->__cur + 1) % this->__depth;
+                    this->__file->wait(this->__cur);
+                }
+            }
+            catch (i_op::error_msg const&) { this->__good = false; }
+            this->__offset += this->__fill;
+            this->__fill = 0;
+        }
+
+
+    public:
+        /**
+         * @brief Creates file at `_path`
+         *
+         * @param _size_hint expected size of whole file, if known (0 otherwise) - files that fit in single buffer
+         *      get only one, smaller buffer
+         * @param _buffer size of single buffer - the largest block that `reserve` can provide
+         * @throw std::bad_alloc – if buffers cannot be allocated
+         */
+        async_writer(char const* _path, uint64_t _size_hint = 0, size_t _buffer = Write_Buffer)
+        {
+            this->__size = (_buffer + Write_Align - 1) / Write_Align * Write_Align;
+            this->__depth = Write_Depth;
+            if (_size_hint > 0 && _size_hint <= this->__size)
+            {
+                this->__size = (_size_hint + Write_Align - 1) / Write_Align * Write_Align;
+                this->__depth = 1;
+            }
+
+            this->__block = std::malloc(this->__size * this->__depth + Write_Align);
+            if (this->__block == nullptr) { throw std::bad_alloc(); }
+            this->__bufs = (uint8_t*)(((uintptr_t)this->__block + Write_Align - 1) / Write_Align * Write_Align);
+            try
+            {
+                this->__file = new i_op::async_file(_path, this->__depth, use_ring);
+                this->__good = true;
+            }
+            catch (i_op::error_msg const&) {}
+        }
+
+        ~async_writer()
+        {
+            this->finish();
+            delete this->__file;
+            std::free(this->__block);
+        }
+
+        /// @return `true` if no write failed so far
+        bool good() const { return this->__good; }
+
+        /// @return Count of bytes written so far (offset of next byte)
+        uint64_t tell() const { return this->__offset + this->__fill; }
+
+        /**
+         * @brief Provides `_len` consecutive bytes (at most size of single buffer) to be filled by caller - they
+         *      are written at `tell()`, and pointer is valid only until next call
+         */
+        uint8_t* reserve(size_t _len)
+        {
+            if (this->__fill + _len > this->__size) { this->submit(); }
+            uint8_t* at = this->buffer(this->__cur) + this->__fill;
+            this->__fill += _len;
+            return at;
+        }
+
+        /**
+         * @brief Appends `_len` bytes of `_data`, splitting them between buffers as needed
+         */
+        void write(void const* _data, size_t _len)
+        {
+            uint8_t const* data = (uint8_t const*)_data;
+            while (_len > 0)
+            {
+                if (this->__fill == this->__size) { this->submit(); }
+                size_t part = std::min(_len, this->__size - this->__fill);
+                std::memcpy(this->buffer(this->__cur) + this->__fill, data, part);
+                this->__fill += part;
+                data += part;
+                _len -= part;
+            }
+        }
+
+        /**
+         * @brief Writes buffered data, and waits until all of it is written to file
+         *
+         * @return `true` if no write failed so far
+         */
+        bool finish()
+        {
+            if (this->__file == nullptr) { return false; }
+            this->submit(true);
+            try { this->__file->wait_all(); }
+            catch (i_op::error_msg const&) { this->__good = false; }
+            return this->__good;
+        }
+
+        /**
+         * @brief Overwrites `_len` bytes at `_offset`, that was already written - buffered data is finished first
+         *
+         * @return `true` if no write failed so far
+         */
+        bool write_at(uint64_t _offset, void const* _data, size_t _len)
+        {
+            if (!this->finish()) { return false; }
+            try { this->__file->write_now(_data, _len, _offset); }
+            catch (i_op::error_msg const&) { this->__good = false; }
+            return this->__good;
+        }
+    };
+}
@@ -3,7 +3,15 @@
 #include <stdio.h>
 #include <vector>
 #include <cstdint>
-#include <fstream>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <new>
+#include <numeric>
+
+#include "async_writer.hpp"
+#include "../interoperability/mapped_file.hpp"
 
 namespace bmp
 {
@@ -47,6 +55,16 @@ namespace bmp
     } pixel_t;
 #pragma pack(pop)
 
+#pragma pack(push, 1)
+    typedef struct palette_entry
+    {
+        uint8_t b;
+        uint8_t g;
+        uint8_t r;
+        uint8_t reserved = 0;
+    } palette_entry_t;
+#pragma pack(pop)
+
     uint32_t little_end(uint32_t _num)
     {
         short int word = 0x0001;
@@ -73,10 +91,12 @@ namespace bmp
         return (_num << 8) | (_num >> 8);
     }
 
-    file_header_t file_header(uint32_t _height, uint32_t _stride)
+    file_header_t file_header(uint32_t _height, uint32_t _stride, uint32_t _palette_n = 0)
     {
-        uint32_t f_off = sizeof(file_header_t) + sizeof(info_header_t);
-        uint32_t f_size = f_off + (_height * _stride);
+        uint32_t f_off = sizeof(file_header_t) + sizeof(info_header_t) + _palette_n * sizeof(palette_entry_t);
+        uint64_t size = f_off + (uint64_t)_height * _stride;
+        /// size of files above 4 GB cannot be stored - 0 is written instead, which most readers accept
+        uint32_t f_size = size > UINT32_MAX ? 0 : (uint32_t)size;
 
         file_header_t fh{};
 
@@ -87,83 +107,400 @@ namespace bmp
     }
 
     /**
-     * @brief Saves monochromatic bmp image to file
-     *
-     * @param _img `vector` that contains image (vector[height][width])
-     * @param _path file path of output
+     * @param _depth bits per pixel - 24 for RGB pixels, 8 or 1 for indices of palette
+     * @param _palette_n count of colours in palette (0 for RGB pixels)
      */
-    info_header_t info_header(uint32_t _height, uint32_t _width)
+    info_header_t info_header(uint32_t _height, uint32_t _width, uint16_t _depth = 8 * Bytes_Per_Px, uint32_t _palette_n = 0)
     {
         info_header_t ih{};
 
         ih.header_size = little_end((uint32_t)sizeof(info_header_t));
         ih.img_width = little_end((int32_t)_width);
         ih.img_height = little_end((int32_t)_height);
+        ih.color_depth = little_end(_depth);
+        ih.color_palette_n = little_end(_palette_n);
 
         return ih;
     }
 
     /**
-     * @brief Saves monochromatic bmp image to file
-     * 
-     * @param _img `vector` that contains image (vector[height][width], root in left-bottom corner)
-     * @param _path file path of output
+     * @return Size of row of `_width` pixels of `_depth` bits, padded to multiple of 4 bytes
+     */
+    inline uint32_t stride(uint32_t _width, uint16_t _depth)
+    {
+        return (uint32_t)(((uint64_t)_width * _depth + 31) / 32 * 4);
+    }
+
+    /**
+     * @return Size of whole file of `_height` rows of `_stride` bytes, with `_palette_n` palette entries
+     */
+    inline uint64_t file_size(uint32_t _height, uint32_t _stride, uint32_t _palette_n = 0)
+    {
+        return sizeof(file_header_t) + sizeof(info_header_t) + _palette_n * sizeof(palette_entry_t) + (uint64_t)_stride * _height;
+    }
+
+    /**
+     * @brief Palette of `_levels` gray levels, spread evenly from black to white
+     */
+    inline std::vector<pixel_t> gray_palette(int _levels)
+    {
+        std::vector<pixel_t> palette;
+        for (int i = 0; i < _levels; i++)
+        {
+            uint8_t v = (uint8_t)(_levels == 1 ? 0 : i * 255 / (_levels - 1));
+            palette.push_back(pixel_t{ v, v, v });
+        }
+        return palette;
+    }
+
+    /**
+     * @brief Colour of `_t` on heat ramp - black at 0, through blue, red and yellow, to white at 1 (values
+     *      outside of 0..1 are clamped)
      */
-    void save_bitmap_mono(std::vector<std::vector<uint8_t>> _img, char const* _path)
+    inline pixel_t color_ramp(double _t)
     {
-        uint32_t width_bytes = _img[0].size() * Bytes_Per_Px;
+        pixel_t const stops[] = { { 0, 0, 0 }, { 0, 0, 192 }, { 224, 0, 64 }, { 255, 224, 0 }, { 255, 255, 255 } };
+        constexpr int last = sizeof(stops) / sizeof(stops[0]) - 1;
 
-        uint8_t pad[] = { 0, 0, 0 };
-        uint8_t pad_len = (4 - width_bytes % 4) % 4;
+        double pos = std::min(std::max(_t, 0.0), 1.0) * last;
+        int i = std::min((int)pos, last - 1);
+        double f = pos - i;
+        auto mix = [&](uint8_t _a, uint8_t _b) { return (uint8_t)(_a + (_b - _a) * f + 0.5); };
+        return pixel_t{ mix(stops[i].r, stops[i + 1].r), mix(stops[i].g, stops[i + 1].g), mix(stops[i].b, stops[i + 1].b) };
+    }
+
+    /**
+     * @brief View of image held in memory - `height` rows of `width` elements, that begin `stride` elements
+     *      apart. Rows are addressed bottom-up (row 0 is bottom of image, as in bmp file), so that image is
+     *      written in order of memory. Views do not own memory, and are cheap to copy
+     *
+     * @tparam T type of pixels - `uint8_t` for gray levels or palette indices, `pixel_t` for colours
+     */
+    template<typename T>
+    struct view
+    {
+        /// @brief First pixel of bottom row
+        T* data;
+        uint32_t width;
+        uint32_t height;
+        /// @brief Distance between rows, in elements
+        ptrdiff_t stride;
+
+        /// @return Row `_y`, counted from bottom of image
+        T* row(uint32_t _y) const { return this->data + _y * this->stride; }
+        /// @return Row `_y`, counted from top of image
+        T* top(uint32_t _y) const { return this->row(this->height - 1 - _y); }
+
+        /// @return Pixel `_x`, `_y` (with `_y` counted from bottom of image)
+        T& operator ()(uint32_t _x, uint32_t _y) const { return this->row(_y)[_x]; }
+
+        /// @return View of rectangle with left-bottom corner at `_x`, `_y`
+        view sub(uint32_t _x, uint32_t _y, uint32_t _width, uint32_t _height) const
+        {
+            return view{ this->row(_y) + _x, _width, _height, this->stride };
+        }
+
+        /// @brief Converts to view of constant pixels
+        template<typename U>
+        operator view<U const>() const { return view<U const>{ this->data, this->width, this->height, this->stride }; }
+    };
+
+    /// @brief Alignment of rows of `image` in bytes - cache line, so that threads filling distinct rows never share one
+    constexpr size_t Row_Align = 64;
+
+    /**
+     * @brief Image held in single contiguous block of memory, with rows aligned to `Row_Align` bytes - instead
+     *      of one allocation per row. Pixels start zeroed. Objects are movable, but not copyable - pass `view`
+     *      to functions instead
+     *
+     * @tparam T trivial type of pixels
+     */
+    template<typename T>
+    class image
+    {
+    private:
+        void* __block{ nullptr };
+        view<T> __view{ nullptr, 0, 0, 0 };
+
+    public:
+        image(image const&) = delete;
+        image& operator =(image const&) = delete;
 
-        std::fstream img(_path, img.binary | img.out);
-        
-        auto fh = file_header(_img.size(), width_bytes + pad_len);
-        img.write((char*)&fh, sizeof(fh));
-        
-        auto ih = info_header(_img.size(), _img[0].size());
-        img.write((char*)&ih, sizeof(ih));
+        /**
+         * @throw std::bad_alloc – if memory for image cannot be allocated
+         */
+        image(uint32_t _width, uint32_t _height)
+        {
+            /* =================================================================================== */
+            /* Stride is rounded up, so that every row begins on boundary - for 3-byte pixels, too */
+            /* =================================================================================== */
+            size_t elems = Row_Align / std::gcd(Row_Align, sizeof(T));
+            size_t stride = ((size_t)_width + elems - 1) / elems * elems;
+
+            this->__block = std::calloc(stride * _height * sizeof(T) + Row_Align, 1);
+            if (this->__block == nullptr) { throw std::bad_alloc(); }
+
+            auto addr = (uintptr_t)this->__block;
+            T* data = (T*)((addr + Row_Align - 1) / Row_Align * Row_Align);
+            this->__view = view<T>{ data, _width, _height, (ptrdiff_t)stride };
+        }
 
-        for (auto row : _img)
+        image(image&& _other): __block(_other.__block), __view(_other.__view)
         {
-            for (auto px : row)
+            _other.__block = nullptr;
+            _other.__view = view<T>{ nullptr, 0, 0, 0 };
+        }
+
+        ~image()
+        {
+            std::free(this->__block);
+        }
+
+        /// @return View of whole image
+        view<T> pixels() const { return this->__view; }
+
+        uint32_t width() const { return this->__view.width; }
+        uint32_t height() const { return this->__view.height; }
+
+        operator view<T>() const { return this->__view; }
+        operator view<T const>() const { return this->__view; }
+    };
+
+    /**
+     * @brief Streaming writer of bmp image - rows are passed one by one in file order (bottom-up, so root in
+     *      left-bottom corner is first), and written in large blocks by `util::async_writer`, so that next rows
+     *      are produced while previous ones go to disk. Only few buffers of `util::Write_Buffer` bytes are held,
+     *      no matter how large image is.
+     *
+     * Image is either 24-bit RGB, or 8-bit or 1-bit palettized - then rows contain palette indices, which
+     * shrinks file (and time spent writing it) 3 or 24 times
+     */
+    class writer
+    {
+    private:
+        uint32_t __width;
+        uint16_t __depth;
+        uint32_t __stride;
+        util::async_writer __out;
+
+        writer(writer const&) = delete;
+
+
+    public:
+        /**
+         * @brief Creates file at `_path`, and writes its headers
+         *
+         * @param _depth bits per pixel - 24, 8 or 1
+         * @param _palette colours of indices, for 8 and 1 bit images (at most 256 or 2 of them)
+         */
+        writer(char const* _path, uint32_t _width, uint32_t _height, uint16_t _depth = 8 * Bytes_Per_Px, std::vector<pixel_t> const& _palette = {}):
+            __width(_width), __depth(_depth), __stride(stride(_width, _depth)),
+            __out(_path, file_size(_height, __stride, _depth == 8 * Bytes_Per_Px ? 0 : _palette.size()), std::max(util::Write_Buffer, (size_t)__stride))
+        {
+            uint32_t palette_n = _depth == 8 * Bytes_Per_Px ? 0 : _palette.size();
+
+            auto fh = file_header(_height, this->__stride, palette_n);
+            this->__out.write(&fh, sizeof(fh));
+
+            auto ih = info_header(_height, _width, _depth, palette_n);
+            this->__out.write(&ih, sizeof(ih));
+
+            for (uint32_t i = 0; i < palette_n; i++)
+            {
+                palette_entry_t entry{ _palette[i].b, _palette[i].g, _palette[i].r };
+                this->__out.write(&entry, sizeof(entry));
+            }
+        }
+
+        /// @return `true` if no write failed so far
+        bool good() const { return this->__out.good(); }
+
+        /**
+         * @brief Writes buffered rows to file, and waits until they are written
+         *
+         * @return `true` if no write failed so far
+         */
+        bool finish()
+        {
+            return this->__out.finish();
+        }
+
+        /**
+         * @brief Appends row of `_width` pixels - gray levels for 24 bit image, palette indices otherwise
+         *      (for 1 bit image, every non-zero index is treated as 1)
+         */
+        void row(uint8_t const* _row)
+        {
+            uint8_t* px = this->__out.reserve(this->__stride);
+            std::fill(px + (this->__depth == 1 ? 0 : (size_t)this->__width * this->__depth / 8), px + this->__stride, 0);
+
+            switch (this->__depth)
             {
-                pixel_t pix{ px, px, px };
-                img.write((char*)&pix, sizeof(pix));
+            case 8 * Bytes_Per_Px:
+                for (uint32_t x = 0; x < this->__width; x++, px += Bytes_Per_Px)
+                {
+                    px[0] = px[1] = px[2] = _row[x];
+                }
+                break;
+            case 8:
+                std::copy(_row, _row + this->__width, px);
+                break;
+            case 1:
+                /* ====================================================== */
+                /* Leftmost pixel of every 8 goes to most significant bit */
+                /* ====================================================== */
+                for (uint32_t x = 0; x < this->__width; x++)
+                {
+                    if (_row[x] != 0) { px[x >> 3] |= (uint8_t)(0x80 >> (x & 7)); }
+                }
+                break;
             }
-            img.write((char*)pad, pad_len);
         }
+
+        /**
+         * @brief Appends row of `_width` colour pixels - for 24 bit image only
+         */
+        void row(pixel_t const* _row)
+        {
+            uint8_t* px = this->__out.reserve(this->__stride);
+            std::fill(px + this->__width * Bytes_Per_Px, px + this->__stride, 0);
+
+            /* =========================================== */
+            /* Colour pixels are stored in file as B, G, R */
+            /* =========================================== */
+            for (uint32_t x = 0; x < this->__width; x++, px += Bytes_Per_Px)
+            {
+                px[0] = _row[x].b;
+                px[1] = _row[x].g;
+                px[2] = _row[x].r;
+            }
+        }
+    };
+
+    /**
+     * @brief Saves monochromatic bmp image to file
+     *
+     * @param _img gray levels of image (root in left-bottom corner)
+     * @param _path file path of output
+     * @return `true` if whole image was written
+     */
+    bool save_bitmap_mono(view<uint8_t const> const& _img, char const* _path)
+    {
+        writer img(_path, _img.width, _img.height);
+        for (uint32_t y = 0; y < _img.height; y++)
+        {
+            img.row(_img.row(y));
+        }
+        return img.finish();
     }
 
 
     /**
      * @brief Saves colour bmp image to file
      *
-     * @param _img `vector` that contains image (vector[height][width], root in left-bottom corner)
+     * @param _img pixels of image (root in left-bottom corner)
      * @param _path file path of output
+     * @return `true` if whole image was written
      */
-    void save_bitmap_rgb(std::vector<std::vector<pixel_t>> _img, char const* _path)
+    bool save_bitmap_rgb(view<pixel_t const> const& _img, char const* _path)
     {
-        uint32_t width_bytes = _img[0].size() * Bytes_Per_Px;
+        writer img(_path, _img.width, _img.height);
+        for (uint32_t y = 0; y < _img.height; y++)
+        {
+            img.row(_img.row(y));
+        }
+        return img.finish();
+    }
 
-        uint8_t pad[] = { 0, 0, 0 };
-        uint8_t pad_len = (4 - width_bytes % 4) % 4;
+    /**
+     * @brief Saves bmp image to file, with rows produced on demand - only `_band` rows are kept in memory at once
+     *
+     * @param _fill function `void(uint32_t y, uint32_t rows, uint8_t* const* out)`, that fills `rows` consecutive
+     *      rows starting from `y` (counted from top of image) - `out[i]` is row `y + i`, and gets gray levels
+     *      for 24 bit image, or palette indices otherwise
+     * @param _depth bits per pixel - 24, 8 or 1
+     * @param _palette colours of indices, for 8 and 1 bit images
+     * @param _band count of rows filled by single call of `_fill`
+     * @return `true` if whole image was written
+     */
+    template<typename F>
+    bool stream_bitmap(char const* _path, uint32_t _width, uint32_t _height, F _fill,
+        uint16_t _depth = 8 * Bytes_Per_Px, std::vector<pixel_t> const& _palette = {}, uint32_t _band = 256)
+    {
+        writer img(_path, _width, _height, _depth, _palette);
+        image<uint8_t> band(_width, _band);
+        std::vector<uint8_t*> rows(_band);
+        for (uint32_t i = 0; i < _band; i++) { rows[i] = band.pixels().top(i); }
 
-        std::fstream img(_path, img.binary | img.out);
+        /* ============================================================================== */
+        /* Bands are filled from bottom of image, and their rows written in reverse order */
+        /* ============================================================================== */
+        for (uint32_t end = _height; end > 0;)
+        {
+            uint32_t y = end > _band ? end - _band : 0;
+            _fill(y, end - y, rows.data());
+            for (uint32_t i = end - y; i-- > 0;)
+            {
+                img.row(rows[i]);
+            }
+            end = y;
+        }
+        return img.finish();
+    }
+    /**
+     * @brief Bmp image of 8 bit palette indices, mapped into memory - file size is known upfront, so it is
+     *      created whole, and rows are filled in place by any number of threads, with no buffer or writer in
+     *      between. Objects are neither copyable, nor movable
+     */
+    class mapped_bitmap
+    {
+    private:
+        i_op::mapped_file<uint8_t> __file;
+        view<uint8_t> __px;
 
-        auto fh = file_header(_img.size(), width_bytes + pad_len);
-        img.write((char*)&fh, sizeof(fh));
+        /// @brief Removes previous file at `_path`, so that it is not reused - new mapping is filled with zeros
+        static char const* fresh(char const* _path)
+        {
+            std::remove(_path);
+            return _path;
+        }
 
-        auto ih = info_header(_img.size(), _img[0].size());
-        img.write((char*)&ih, sizeof(ih));
 
-        for (auto row : _img)
+    public:
+        /**
+         * @brief Creates file at `_path`, and writes its headers - pixels are left at 0
+         *
+         * @param _palette colours of indices (at most 256 of them)
+         * @throw i_op::error_msg – contains OS-specific error code
+         */
+        mapped_bitmap(char const* _path, uint32_t _width, uint32_t _height, std::vector<pixel_t> const& _palette):
+            __file(fresh(_path), file_size(_height, stride(_width, 8), _palette.size()))
         {
-            for (auto px : row)
+            uint8_t* at = this->__file.ptr();
+            auto fh = file_header(_height, stride(_width, 8), _palette.size());
+            std::memcpy(at, &fh, sizeof(fh));
+            at += sizeof(fh);
+
+            auto ih = info_header(_height, _width, 8, _palette.size());
+            std::memcpy(at, &ih, sizeof(ih));
+            at += sizeof(ih);
+
+            for (auto const& colour : _palette)
             {
-                img.write((char*)&px, sizeof(px));
+                palette_entry_t entry{ colour.b, colour.g, colour.r };
+                std::memcpy(at, &entry, sizeof(entry));
+                at += sizeof(entry);
             }
-            img.write((char*)pad, pad_len);
+            this->__px = view<uint8_t>{ at, _width, _height, (ptrdiff_t)stride(_width, 8) };
         }
-    }
+
+        /// @return Palette indices of image (root in left-bottom corner, as rows are stored in file)
+        view<uint8_t> pixels() const { return this->__px; }
+
+        /**
+         * @brief Unmaps and closes file, throwing on failure
+         * @throw i_op::error_msg – contains OS-specific error code
+         */
+        void close() { this->__file.close(); }
+    };
 }
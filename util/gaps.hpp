@@ -0,0 +1,161 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "async_writer.hpp"
+
+/* ============================================================================================== */
+/* Compact prime list format - primes are stored as gaps between consecutive ones, each encoded   */
+/* as LEB128 varint (7 bits per byte, high bit set on all bytes but last), so that gaps below 128 */
+/* take single byte. List is divided into chunks of fixed count of primes, and index of chunks    */
+/* allows to start decoding at any of them. All integers outside of chunks are little-endian:     */
+/*                                                                                                */
+/*     header:  "SO2G", u32 version, u64 n, u64 count, u64 chunk primes, u64 chunks,              */
+/*              u64 index offset                                                                  */
+/*     chunks:  varint gaps from first prime of chunk to each next one (chunk primes - 1 gaps)    */
+/*     index:   u64 first prime, u64 file offset of chunk - for every chunk                       */
+/* ============================================================================================== */
+namespace gaps
+{
+    typedef long long llong;
+
+    constexpr uint32_t Version = 1;
+    /// @brief Size of file header in bytes
+    constexpr size_t Header_Size = 48;
+    /// @brief Default count of primes in single chunk
+    constexpr uint64_t Chunk_Primes = 1 << 16;
+    /// @brief Size of encoded gaps that is gathered before passing it to `util::async_writer`
+    constexpr size_t Buffer_Size = 1 << 20;
+
+    /**
+     * @brief Appends `_val` to `_buf` as `_bytes` little-endian bytes
+     */
+    inline void put_le(std::vector<uint8_t>& _buf, uint64_t _val, int _bytes = 8)
+    {
+        for (int i = 0; i < _bytes; i++) { _buf.push_back((uint8_t)(_val >> (8 * i))); }
+    }
+
+    /**
+     * @brief Appends `_val` to `_buf` as LEB128 varint
+     */
+    inline void put_varint(std::vector<uint8_t>& _buf, uint64_t _val)
+    {
+        while (_val >= 0x80)
+        {
+            _buf.push_back((uint8_t)(_val | 0x80));
+            _val >>= 7;
+        }
+        _buf.push_back((uint8_t)_val);
+    }
+
+    /**
+     * @brief Streaming writer of prime list - fed with consecutive segments of bit sieve, so that
+     *      whole range never needs to be held in memory
+     */
+    class writer
+    {
+    private:
+        util::async_writer __file;
+        uint64_t __chunk_primes;
+        /// @brief Encoded gaps not yet written to file
+        std::vector<uint8_t> __buf;
+        /// @brief First prime and file offset of every chunk
+        std::vector<std::pair<uint64_t, uint64_t>> __index;
+        uint64_t __count = 0;
+        uint64_t __last = 0;
+
+        writer(writer const&) = delete;
+
+        void flush()
+        {
+            this->__file.write(this->__buf.data(), this->__buf.size());
+            this->__buf.clear();
+        }
+
+
+    public:
+        /**
+         * @brief Creates file at `_path`, with header to be completed by `finish`
+         *
+         * @param _chunk_primes count of primes in single chunk
+         */
+        writer(char const* _path, uint64_t _chunk_primes = Chunk_Primes):
+            __file(_path), __chunk_primes(_chunk_primes)
+        {
+            std::vector<uint8_t> header(Header_Size, 0);
+            this->__file.write(header.data(), header.size());
+            this->__buf.reserve(Buffer_Size + 16);
+        }
+
+        /// @return `true` if no write failed so far
+        bool good() const { return this->__file.good(); }
+
+        /// @return Count of primes written so far
+        uint64_t count() const { return this->__count; }
+
+        /**
+         * @brief Appends single prime, that must be greater than every previous one
+         */
+        void push(uint64_t _p)
+        {
+            if (this->__count % this->__chunk_primes == 0)
+            {
+                this->__index.push_back({ _p, this->__file.tell() + this->__buf.size() });
+            }
+            else
+            {
+                put_varint(this->__buf, _p - this->__last);
+            }
+            this->__last = _p;
+            this->__count++;
+
+            if (this->__buf.size() >= Buffer_Size) { this->flush(); }
+        }
+
+        /**
+         * @brief Appends primes of bit sieve segment, that holds numbers `_base`..`_base + _len - 1`
+         *      (bit set for composites, as in `sieving_strategy::storage::bit`)
+         */
+        void feed(uint64_t const* _words, llong _base, llong _len)
+        {
+            for (llong w = 0; w * 64 < _len; w++)
+            {
+                uint64_t primes = ~_words[w];
+                if (_len - w * 64 < 64) { primes &= ((uint64_t)1 << (_len - w * 64)) - 1; }
+                while (primes != 0)
+                {
+                    this->push((uint64_t)(_base + w * 64 + __builtin_ctzll(primes)));
+                    primes &= primes - 1;
+                }
+            }
+        }
+
+        /**
+         * @brief Writes chunk index and completes header - no primes may be pushed afterwards
+         *
+         * @param _n upper bound of range that list covers
+         * @return `true` if whole file was written
+         */
+        bool finish(uint64_t _n)
+        {
+            uint64_t index_offset = this->__file.tell() + this->__buf.size();
+            for (auto const& entry : this->__index)
+            {
+                put_le(this->__buf, entry.first);
+                put_le(this->__buf, entry.second);
+            }
+            this->flush();
+
+            std::vector<uint8_t> header{ 'S', 'O', '2', 'G' };
+            put_le(header, Version, 4);
+            put_le(header, _n);
+            put_le(header, this->__count);
+            put_le(header, this->__chunk_primes);
+            put_le(header, this->__index.size());
+            put_le(header, index_offset);
+
+            return this->__file.write_at(0, header.data(), header.size());
+        }
+    };
+}
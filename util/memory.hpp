@@ -9,6 +9,7 @@
 #include <new>
 #include <functional>
 #include <cstring>
+#include <cstdint>
 
 namespace util
 {
@@ -140,6 +141,178 @@ namespace util
         T* end() { return this->__ptr + this->__len; }
     };
 
+    /**
+     * @brief Bump allocator of scratch memory - blocks are carved one after another from large chunks, and are
+     *      never freed one by one. `rewind` drops every block taken after given mark, and `reset` all of them,
+     *      in O(1) - chunks are kept for next blocks, so loops that run once per segment or tile take their
+     *      scratch without calling `std::malloc` (apart from first iterations, that grow chunks).
+     *
+     * Arena is not thread-safe - every thread has its own one (see `local`), that is best used through `scope`.
+     * Objects are neither copyable, nor movable
+     */
+    class arena final
+    {
+    private:
+        /// @brief Header of chunk - its usable memory follows
+        struct chunk
+        {
+            chunk* next;
+            std::size_t size;
+            std::size_t used;
+
+            unsigned char* data() { return (unsigned char*)(this + 1); }
+        };
+
+        chunk* __first = nullptr;
+        /// @brief Chunk that blocks are taken from - chunks after it are unused, and get reset on entry
+        chunk* __cur = nullptr;
+
+
+    public:
+        /// @brief Size of single chunk - larger ones are made only for larger blocks
+        static constexpr std::size_t Chunk_Size = 1 << 20;
+        /// @brief Default alignment of blocks - cache line, so that blocks handed to distinct threads share none
+        static constexpr std::size_t Align = 64;
+
+        /// @brief Position in arena, that it can be rewound to
+        struct mark
+        {
+            chunk* at;
+            std::size_t used;
+        };
+
+        arena() = default;
+        arena(arena const&) = delete;
+        arena& operator =(arena const&) = delete;
+
+        ~arena()
+        {
+            while (this->__first != nullptr)
+            {
+                chunk* next = this->__first->next;
+                std::free(this->__first);
+                this->__first = next;
+            }
+        }
+
+        /**
+         * @brief Takes uninitialized block of `_n_elem` elements
+         *
+         * @param _align alignment of block - power of 2, at most `Align` is guaranteed to need no extra memory
+         * @throw std::bad_alloc – if new chunk cannot be allocated
+         */
+        template<typename T>
+        T* alloc(std::size_t _n_elem, std::size_t _align = Align)
+        {
+            std::size_t bytes = _n_elem * sizeof(T);
+            for (;;)
+            {
+                if (this->__cur != nullptr)
+                {
+                    std::uintptr_t base = (std::uintptr_t)this->__cur->data();
+                    std::size_t at = ((base + this->__cur->used + _align - 1) & ~(std::uintptr_t)(_align - 1)) - base;
+                    if (at + bytes <= this->__cur->size)
+                    {
+                        this->__cur->used = at + bytes;
+                        return (T*)(base + at);
+                    }
+                }
+
+                /* ============================================================================== */
+                /* Move to next chunk if it fits block, or put new one in front of it otherwise - */
+                /* too small chunks stay for later, smaller blocks                                */
+                /* ============================================================================== */
+                chunk* next = this->__cur != nullptr ? this->__cur->next : this->__first;
+                if (next != nullptr && next->size >= bytes + _align)
+                {
+                    this->__cur = next;
+                    this->__cur->used = 0;
+                    continue;
+                }
+
+                std::size_t size = bytes + _align > Chunk_Size ? bytes + _align : Chunk_Size;
+                chunk* fresh = (chunk*)std::malloc(sizeof(chunk) + size);
+                if (fresh == nullptr) { throw std::bad_alloc(); }
+                *fresh = chunk{ next, size, 0 };
+                if (this->__cur != nullptr) { this->__cur->next = fresh; }
+                else { this->__first = fresh; }
+                this->__cur = fresh;
+            }
+        }
+
+        /**
+         * @brief Takes block of `_n_elem` elements, filled with zeros - see `alloc`
+         * @throw std::bad_alloc – if new chunk cannot be allocated
+         */
+        template<typename T>
+        T* calloc(std::size_t _n_elem, std::size_t _align = Align)
+        {
+            T* block = this->alloc<T>(_n_elem, _align);
+            std::memset((void*)block, 0, _n_elem * sizeof(T));
+            return block;
+        }
+
+        /// @return Current position, that `rewind` can return to
+        mark where() const { return mark{ this->__cur, this->__cur != nullptr ? this->__cur->used : 0 }; }
+
+        /**
+         * @brief Drops every block taken after `_mark` (which must not be dropped itself)
+         */
+        void rewind(mark const& _mark)
+        {
+            if (_mark.at == nullptr) { this->reset(); }
+            else
+            {
+                this->__cur = _mark.at;
+                this->__cur->used = _mark.used;
+            }
+        }
+
+        /**
+         * @brief Drops every block - chunks are kept for reuse
+         */
+        void reset()
+        {
+            this->__cur = this->__first;
+            if (this->__cur != nullptr) { this->__cur->used = 0; }
+        }
+
+        /**
+         * @return Arena of calling thread - created on first use, and freed when thread ends
+         */
+        static arena& local()
+        {
+            thread_local arena instance;
+            return instance;
+        }
+
+        /**
+         * @brief Blocks of arena, that live for current scope - it is rewound to where it was on construction,
+         *      once scope ends. Scopes must end in reverse order of construction (as automatic objects do)
+         */
+        class scope final
+        {
+        private:
+            arena& __arena;
+            mark __mark;
+
+        public:
+            scope(scope const&) = delete;
+            scope& operator =(scope const&) = delete;
+
+            explicit scope(arena& _arena = arena::local()) : __arena(_arena), __mark(_arena.where()) {}
+            ~scope() { this->__arena.rewind(this->__mark); }
+
+            /// @brief See `arena::alloc`
+            template<typename T>
+            T* alloc(std::size_t _n_elem, std::size_t _align = Align) { return this->__arena.alloc<T>(_n_elem, _align); }
+
+            /// @brief See `arena::calloc`
+            template<typename T>
+            T* calloc(std::size_t _n_elem, std::size_t _align = Align) { return this->__arena.calloc<T>(_n_elem, _align); }
+        };
+    };
+
     template<typename T>
     T* t_calloc(std::size_t _n_elem)
     {
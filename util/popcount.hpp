@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define UTIL_POPCOUNT_DISPATCH
+#endif
+
+/* ============================================================================================ */
+/* Popcount of long runs of words, without compiler flags that tie build to newer CPUs - on x86 */
+/* GCC compiles AVX2 (nibble lookup with `vpshufb`) and POPCNT variants next to generic one,    */
+/* and the best one supported by host is picked at run time                                     */
+/* ============================================================================================ */
+namespace util
+{
+    /// @brief Count of words, below which AVX2 variant is not worth its setup
+    constexpr size_t Popcount_Simd_Words = 16;
+
+    /// @return Count of set bits in `_n` words at `_words`
+    inline uint64_t popcount_generic(uint64_t const* _words, size_t _n)
+    {
+        uint64_t cnt = 0;
+        for (size_t i = 0; i < _n; i++) { cnt += __builtin_popcountll(_words[i]); }
+        return cnt;
+    }
+
+#ifdef UTIL_POPCOUNT_DISPATCH
+    /// @return Count of set bits in `_n` words at `_words` - with POPCNT instruction
+    __attribute__((target("popcnt"))) inline uint64_t popcount_popcnt(uint64_t const* _words, size_t _n)
+    {
+        uint64_t cnt = 0;
+        for (size_t i = 0; i < _n; i++) { cnt += __builtin_popcountll(_words[i]); }
+        return cnt;
+    }
+
+    /**
+     * @return Count of set bits in `_n` words at `_words` - bits of every nibble are looked up in table,
+     *      and byte counts are summed into 64 bit lanes
+     */
+    __attribute__((target("avx2,popcnt"))) inline uint64_t popcount_avx2(uint64_t const* _words, size_t _n)
+    {
+        __m256i const table = _mm256_setr_epi8(
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        __m256i const low = _mm256_set1_epi8(0x0f);
+        __m256i sum = _mm256_setzero_si256();
+
+        size_t i = 0;
+        for (; i + 4 <= _n; i += 4)
+        {
+            __m256i v = _mm256_loadu_si256((__m256i const*)(_words + i));
+            __m256i bytes = _mm256_add_epi8(
+                _mm256_shuffle_epi8(table, _mm256_and_si256(v, low)),
+                _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+            sum = _mm256_add_epi64(sum, _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+        }
+
+        uint64_t cnt = (uint64_t)_mm256_extract_epi64(sum, 0) + (uint64_t)_mm256_extract_epi64(sum, 1)
+            + (uint64_t)_mm256_extract_epi64(sum, 2) + (uint64_t)_mm256_extract_epi64(sum, 3);
+        for (; i < _n; i++) { cnt += __builtin_popcountll(_words[i]); }
+        return cnt;
+    }
+#endif
+
+    /// @return Count of set bits in `_n` words at `_words` - with the fastest variant supported by host
+    inline uint64_t popcount(uint64_t const* _words, size_t _n)
+    {
+#ifdef UTIL_POPCOUNT_DISPATCH
+        static int const level = __builtin_cpu_supports("avx2") ? 2 : __builtin_cpu_supports("popcnt") ? 1 : 0;
+        if (level == 2 && _n >= Popcount_Simd_Words) { return popcount_avx2(_words, _n); }
+        if (level >= 1) { return popcount_popcnt(_words, _n); }
+#endif
+        return popcount_generic(_words, _n);
+    }
+}
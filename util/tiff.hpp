@@ -0,0 +1,201 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "../interoperability/async_file.hpp"
+#include "../interoperability/mutex.hpp"
+#include "../interoperability/critical_section.hpp"
+
+/* ============================================================================================= */
+/* Tiled BigTIFF image of gray samples, 1 or 8 bits each - unlike bmp, it has 64 bit offsets and */
+/* is divided into square tiles, that viewers read one by one, so image may be much larger than  */
+/* memory. Tiles are stored uncompressed, in order in which they were finished (by any thread),  */
+/* and located by offset table. All integers are little-endian:                                  */
+/*                                                                                               */
+/*     header:  "II", u16 43, u16 8 (size of offsets), u16 0, u64 offset of IFD (always 16)      */
+/*     IFD:     u64 count of entries, entries of 20 bytes (u16 tag, u16 type, u64 count, 8 bytes */
+/*              of value or its offset) sorted by tag, u64 0 (no next image)                     */
+/*     tables:  u64 file offset of every tile, then u64 byte count of every tile (row-major)     */
+/*     tiles:   `Tile_Side` rows of `Tile_Side` samples each, rows padded to whole byte - also   */
+/*              in tiles that stick out of image                                                 */
+/* ============================================================================================= */
+namespace tiff
+{
+    /// @brief Side of square tile in pixels
+    constexpr uint32_t Tile_Side = 256;
+
+    /// @brief Field types of IFD entries
+    enum type : uint16_t
+    {
+        Short = 3, Long = 4, Rational = 5, Long8 = 16
+    };
+
+    /**
+     * @brief Writes `_val` as `_bytes` little-endian bytes at `_at`
+     */
+    inline void put_le(uint8_t* _at, uint64_t _val, int _bytes = 8)
+    {
+        for (int i = 0; i < _bytes; i++) { _at[i] = (uint8_t)(_val >> (8 * i)); }
+    }
+
+    /**
+     * @brief Writer of tiled image - tiles may be passed from many threads at once, in any order, and each one
+     *      is written to file right away. Objects are neither copyable, nor movable
+     */
+    class writer
+    {
+    private:
+        i_op::async_file __file;
+        uint32_t __width;
+        uint32_t __height;
+        uint16_t __depth;
+        uint32_t __tiles_x;
+        uint32_t __tiles_y;
+        /// @brief File offset of every tile (row-major), 0 until it is written
+        std::vector<uint64_t> __offsets;
+        /// @brief End of file - offset of next tile
+        uint64_t __end;
+        bool __good = true;
+        i_op::mutex __lock;
+
+        writer(writer const&) = delete;
+
+        /// @brief Count of IFD entries
+        static constexpr uint64_t Entries = 14;
+        /// @brief Size of header and IFD, that offset table follows
+        static constexpr uint64_t Head_Size = 16 + 8 + Entries * 20 + 8;
+
+        uint64_t tiles() const { return (uint64_t)this->__tiles_x * this->__tiles_y; }
+
+
+    public:
+        /**
+         * @brief Creates file at `_path` - headers are written by `finish`, once offsets of all tiles are known
+         *
+         * @param _depth bits per sample - 8 for 256 gray levels, or 1 for black (0) and white (1)
+         * @throw i_op::error_msg – contains OS-specific error code
+         */
+        writer(char const* _path, uint32_t _width, uint32_t _height, uint16_t _depth = 8):
+            __file(_path, 1), __width(_width), __height(_height), __depth(_depth),
+            __tiles_x((_width + Tile_Side - 1) / Tile_Side), __tiles_y((_height + Tile_Side - 1) / Tile_Side),
+            __offsets(this->tiles(), 0), __end(Head_Size + 16 * this->tiles())
+        {}
+
+        /// @return `true` if no write failed so far
+        bool good() const { return this->__good; }
+
+        /// @return Size of single tile in file
+        size_t tile_bytes() const { return (size_t)(Tile_Side * this->__depth + 7) / 8 * Tile_Side; }
+
+        /**
+         * @brief Converts tile of `Tile_Side` x `Tile_Side` samples, one byte each, into its layout in file (in
+         *      place) - for 1 bit image, every non-zero sample is treated as 1
+         */
+        void pack(uint8_t* _tile) const
+        {
+            if (this->__depth != 1) { return; }
+
+            /* ================================================================================ */
+            /* Packed byte never lies past samples that are not read yet, so buffer is shared - */
+            /* leftmost sample of every 8 goes to most significant bit                          */
+            /* ================================================================================ */
+            uint8_t* out = _tile;
+            for (uint32_t i = 0; i < Tile_Side * Tile_Side; i += 8)
+            {
+                uint8_t byte = 0;
+                for (uint32_t b = 0; b < 8; b++) { byte |= (uint8_t)((_tile[i + b] != 0) << (7 - b)); }
+                *out++ = byte;
+            }
+        }
+
+        /**
+         * @brief Appends tile `_tx`, `_ty` (counted from left-top corner) to file - safe to call from many threads
+         *
+         * @param _tile `tile_bytes()` bytes of packed tile (see `pack`)
+         * @return `true` if no write failed so far
+         */
+        bool put(uint32_t _tx, uint32_t _ty, uint8_t const* _tile)
+        {
+            uint64_t at;
+            {
+                i_op::critical_section guard(this->__lock);
+                at = this->__end;
+                this->__end += this->tile_bytes();
+                this->__offsets[(uint64_t)_ty * this->__tiles_x + _tx] = at;
+            }
+
+            bool written = true;
+            try { this->__file.write_now(_tile, this->tile_bytes(), at); }
+            catch (i_op::error_msg const&) { written = false; }
+
+            i_op::critical_section guard(this->__lock);
+            this->__good = this->__good && written;
+            return this->__good;
+        }
+
+        /**
+         * @brief Writes header, IFD and offset table - every tile must be put before
+         *
+         * @return `true` if whole file was written
+         */
+        bool finish()
+        {
+            if (!this->__good) { return false; }
+            uint64_t tiles = this->tiles();
+            std::vector<uint8_t> head(Head_Size + 16 * tiles, 0);
+
+            uint8_t* at = head.data();
+            at[0] = at[1] = 'I';
+            put_le(at + 2, 43, 2);
+            put_le(at + 4, 8, 2);
+            put_le(at + 8, 16);
+            put_le(at + 16, Entries);
+            at += 24;
+
+            /* ============================================================================== */
+            /* Values of up to 8 bytes are held in entry itself, larger ones are pointed to - */
+            /* so tables of single tile image lie in IFD                                      */
+            /* ============================================================================== */
+            uint64_t table = Head_Size;
+            auto entry = [&](uint16_t _tag, type _type, uint64_t _count, uint64_t _val)
+            {
+                put_le(at, _tag, 2);
+                put_le(at + 2, _type, 2);
+                put_le(at + 4, _count);
+                put_le(at + 12, _val);
+                at += 20;
+            };
+            entry(256, Long, 1, this->__width);
+            entry(257, Long, 1, this->__height);
+            entry(258, Short, 1, this->__depth);
+            entry(259, Short, 1, 1);            /// no compression
+            entry(262, Short, 1, 1);            /// 0 is black
+            entry(277, Short, 1, 1);            /// samples per pixel
+            entry(282, Rational, 1, 72 | (1ULL << 32));
+            entry(283, Rational, 1, 72 | (1ULL << 32));
+            entry(284, Short, 1, 1);            /// samples are not planar
+            entry(296, Short, 1, 2);            /// resolution in inches
+            entry(322, Long, 1, Tile_Side);
+            entry(323, Long, 1, Tile_Side);
+            entry(324, Long8, tiles, tiles == 1 ? this->__offsets[0] : table);
+            entry(325, Long8, tiles, tiles == 1 ? this->tile_bytes() : table + 8 * tiles);
+
+            for (uint64_t t = 0; t < tiles; t++)
+            {
+                put_le(head.data() + table + 8 * t, this->__offsets[t]);
+                put_le(head.data() + table + 8 * (tiles + t), this->tile_bytes());
+            }
+
+            try
+            {
+                this->__file.write_now(head.data(), head.size(), 0);
+                this->__file.close();
+            }
+            catch (i_op::error_msg const&) { this->__good = false; }
+            return this->__good;
+        }
+    };
+}